@@ -0,0 +1,265 @@
+/**************************************************************************
+*
+*		     Source:  AsyncClient.cpp
+*           Project:  ScorpionServer
+*
+*            Author: trafferty
+*              Date: Oct 17, 2026
+*
+*		Description:
+*			> Pipelining client for the command protocol, see AsyncClient.h
+*
+****************************************************************************/
+
+#include <google/protobuf/io/coded_stream.h>
+
+#include "AsyncClient.h"
+
+using namespace google::protobuf::io;
+
+AsyncClient::AsyncClient(std::shared_ptr<ISocket> socket, bool debug) :
+   m_Debug(debug),
+   m_Name("AsyncClient"),
+   m_Socket(socket),
+   m_Connected(false),
+   m_NextID(0),
+   m_PushCallbackPtr(0),
+   m_Reader("AsyncClient RX"),
+   m_ReadBuffer(32768)
+{
+    m_Log = std::shared_ptr<Logger>(new Logger(m_Name, m_Debug));
+
+    pthread_mutex_init(&m_Working_Pending, NULL);
+    pthread_mutex_init(&m_Working_Send, NULL);
+
+    m_ReadStep = new Callback0<AsyncClient, bool>(this, &AsyncClient::readResponses);
+}
+
+AsyncClient::~AsyncClient()
+{
+    Stop();
+    delete m_ReadStep;
+
+    pthread_mutex_destroy(&m_Working_Send);
+    pthread_mutex_destroy(&m_Working_Pending);
+}
+
+bool AsyncClient::Start()
+{
+    if (nullptr == m_Socket)
+    {
+        m_Log->LogError("No Socket connected");
+        return false;
+    }
+
+    m_Connected = true;
+
+    // readBlock does not block, it backs off briefly when there is nothing
+    // to read; the idle timeout only paces retries once the connection is gone
+    if (!m_Reader.Start(m_ReadStep, 0.1))
+    {
+        m_Log->LogError("Error spawning reader thread");
+        return false;
+    }
+
+    return true;
+}
+
+void AsyncClient::Stop()
+{
+    m_Reader.Stop();
+    failPending();
+}
+
+AsyncClient::ResponseFuture_t AsyncClient::Send(sandbox::Command& cmd)
+{
+    Pending_t pending;
+    pending.callback = 0;
+    ResponseFuture_t future = pending.promise.get_future();
+
+    // registered before sending, the reply can beat sendData back
+    int id = registerPending(pending);
+    cmd.set_id(id);
+
+    if (!sendCommand(cmd))
+    {
+        // dropping the promise breaks the future
+        pthread_mutex_lock(&m_Working_Pending);
+        {
+            m_Pending.erase(id);
+        }
+        pthread_mutex_unlock(&m_Working_Pending);
+    }
+
+    return future;
+}
+
+bool AsyncClient::Send(sandbox::Command& cmd, ICallback* callback)
+{
+    Pending_t pending;
+    pending.callback = callback;
+
+    int id = registerPending(pending);
+    cmd.set_id(id);
+
+    if (!sendCommand(cmd))
+    {
+        pthread_mutex_lock(&m_Working_Pending);
+        {
+            m_Pending.erase(id);
+        }
+        pthread_mutex_unlock(&m_Working_Pending);
+        return false;
+    }
+
+    return true;
+}
+
+void AsyncClient::RegisterPushCallback(ICallback* callback)
+{
+    m_PushCallbackPtr = callback;
+}
+
+size_t AsyncClient::InFlight()
+{
+    size_t inFlight;
+    pthread_mutex_lock(&m_Working_Pending);
+    {
+        inFlight = m_Pending.size();
+    }
+    pthread_mutex_unlock(&m_Working_Pending);
+    return inFlight;
+}
+
+int AsyncClient::registerPending(Pending_t& pending)
+{
+    int id;
+    pthread_mutex_lock(&m_Working_Pending);
+    {
+        id = ++m_NextID;
+        m_Pending.insert(std::make_pair(id, std::move(pending)));
+    }
+    pthread_mutex_unlock(&m_Working_Pending);
+    return id;
+}
+
+bool AsyncClient::sendCommand(sandbox::Command& cmd)
+{
+    bool ret_val = false;
+
+    pthread_mutex_lock(&m_Working_Send);
+    {
+        size_t msgSize = cmd.ByteSizeLong();
+        m_TxBuffer.resize(CodedOutputStream::VarintSize32((uint32_t)msgSize) + msgSize);
+
+        uint8_t* out = (uint8_t*)&m_TxBuffer[0];
+        out = CodedOutputStream::WriteVarint32ToArray((uint32_t)msgSize, out);
+        cmd.SerializeWithCachedSizesToArray(out);
+
+        if (m_Connected)
+            ret_val = m_Socket->sendData(m_TxBuffer.data(), (int)m_TxBuffer.size());
+    }
+    pthread_mutex_unlock(&m_Working_Send);
+
+    if (!ret_val)
+        m_Log->LogError("Error sending ", cmd.method(), " command ", cmd.id());
+
+    return ret_val;
+}
+
+//=============================================================================
+// readResponses
+//-----------------------------------------------------------------------------
+// Reader thread step: reads what is available and completes every whole
+// frame in it.  Only idle (false) once the connection is gone.
+//=============================================================================
+bool AsyncClient::readResponses()
+{
+    if (!m_Connected)
+        return false;
+
+    int numRead = 0;
+    if (!m_Socket->readBlock(m_ReadBuffer.data(), (int)m_ReadBuffer.size(), numRead, 0.1) || (numRead < 0))
+    {
+        m_Log->LogWarn("Connection lost, failing ", InFlight(), " command(s) in flight");
+        m_Connected = false;
+        failPending();
+        return false;
+    }
+
+    if (numRead == 0)
+        return true;
+
+    m_RxBuffer.append(m_ReadBuffer.data(), numRead);
+
+    size_t consumed = 0;
+    while (consumed < m_RxBuffer.size())
+    {
+        CodedInputStream coded_input((const google::protobuf::uint8*)m_RxBuffer.data() + consumed,
+                                     (int)(m_RxBuffer.size() - consumed));
+        google::protobuf::uint32 size;
+        if (!coded_input.ReadVarint32(&size))
+            break;
+
+        int hdrSize = coded_input.CurrentPosition();
+        if (m_RxBuffer.size() - consumed - hdrSize < size)
+            break;
+
+        if (m_Response.ParseFromArray(m_RxBuffer.data() + consumed + hdrSize, size))
+            dispatchResponse();
+        else
+            m_Log->LogWarn("Unable to parse ", size, " byte response");
+
+        consumed += hdrSize + size;
+    }
+    m_RxBuffer.erase(0, consumed);
+
+    return true;
+}
+
+void AsyncClient::dispatchResponse()
+{
+    Pending_t pending;
+    bool found = false;
+
+    pthread_mutex_lock(&m_Working_Pending);
+    {
+        std::map<int, Pending_t>::iterator it = m_Pending.find(m_Response.id());
+        if (it != m_Pending.end())
+        {
+            pending = std::move(it->second);
+            m_Pending.erase(it);
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&m_Working_Pending);
+
+    if (!found)
+    {
+        if (m_PushCallbackPtr)
+            m_PushCallbackPtr->Invoke((void*)(intptr_t)m_Response.id(), (void*)&m_Response);
+        return;
+    }
+
+    if (pending.callback)
+        pending.callback->Invoke((void*)(intptr_t)m_Response.id(), (void*)&m_Response);
+    else
+        pending.promise.set_value(m_Response);
+}
+
+void AsyncClient::failPending()
+{
+    std::map<int, Pending_t> failed;
+    pthread_mutex_lock(&m_Working_Pending);
+    {
+        failed.swap(m_Pending);
+    }
+    pthread_mutex_unlock(&m_Working_Pending);
+
+    // futures break when their promise goes away with the map
+    for (std::map<int, Pending_t>::iterator it = failed.begin(); it != failed.end(); ++it)
+    {
+        if (it->second.callback)
+            it->second.callback->Invoke((void*)(intptr_t)it->first, NULL);
+    }
+}
@@ -0,0 +1,104 @@
+/**************************************************************************
+*
+*		     Source:  AsyncClient.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Pipelining client for the command protocol.  Any number of
+*		    commands can be in flight on one connection; a reader
+*		    thread matches each Response to its command by id, so
+*		    replies may complete in any order.  Callers get a future,
+*		    or a callback invoked on the reader thread.
+*
+****************************************************************************/
+#ifndef __ASYNC_CLIENT_H__
+#define __ASYNC_CLIENT_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <future>
+#include <atomic>
+
+#include <pthread.h>
+
+#include "Logger.h"
+#include "ISocket.h"
+#include "Callback.h"
+#include "WorkerThread.h"
+#include "payload.pb.h"
+
+class AsyncClient
+{
+public:
+    typedef std::future<sandbox::Response> ResponseFuture_t;
+
+             AsyncClient(std::shared_ptr<ISocket> socket, bool debug = false);
+    virtual ~AsyncClient();
+
+    // socket must already be connected (client mode)
+    bool Start();
+    void Stop();
+
+    // Send: assigns cmd a fresh id and sends it.  The future throws
+    //       std::future_error (broken_promise) if the connection drops
+    //       or the client is stopped before the reply arrives.
+    ResponseFuture_t Send(sandbox::Command& cmd);
+
+    // Send: as above, but callback is invoked on the reader thread with
+    //       the command id and the const sandbox::Response* (NULL if the
+    //       reply will never come).  Returns FALSE if sending failed.
+    bool Send(sandbox::Command& cmd, ICallback* callback);
+
+    // Invoked like a Send callback for responses no command is waiting
+    // for (subscription pushes)
+    void RegisterPushCallback(ICallback* callback);
+
+    size_t InFlight();
+
+protected:
+    struct Pending_t
+    {
+        std::promise<sandbox::Response> promise;
+        ICallback*                      callback;   // instead of the promise
+    };
+
+    bool m_Debug;
+    std::string m_Name;
+    std::shared_ptr<Logger> m_Log;
+
+    std::shared_ptr<ISocket> m_Socket;
+    std::atomic<bool> m_Connected;
+
+    std::map<int, Pending_t> m_Pending;
+    int m_NextID;
+    pthread_mutex_t m_Working_Pending;
+
+    // serializes whole frames onto the socket
+    std::string m_TxBuffer;
+    pthread_mutex_t m_Working_Send;
+
+    ICallback* m_PushCallbackPtr;
+
+    // reader thread state
+    WorkerThread m_Reader;
+    Callback0<AsyncClient, bool>* m_ReadStep;
+    std::vector<char> m_ReadBuffer;
+    std::string m_RxBuffer;
+    sandbox::Response m_Response;
+
+    int registerPending(Pending_t& pending);
+    bool sendCommand(sandbox::Command& cmd);
+    bool readResponses();
+    void dispatchResponse();
+    void failPending();
+
+    AsyncClient(const AsyncClient&);
+    AsyncClient& operator=(const AsyncClient&);
+};
+
+#endif
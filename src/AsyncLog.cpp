@@ -0,0 +1,437 @@
+/**************************************************************************
+*
+*		     Source:  AsyncLog.cpp
+*           Project:  ScorpionServer
+*
+*            Author: trafferty
+*              Date: Oct 17, 2026
+*
+*		Description:
+*			> Asynchronous Logger backend, see AsyncLog.h
+*
+****************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+
+#include <vector>
+#include <streambuf>
+
+#include "AsyncLog.h"
+#include "Logger.h"
+#include "Callback.h"
+#include "WorkerThread.h"
+
+namespace
+{
+    // streambuf over one record's text; whatever does not fit is dropped
+    class RecordBuf : public std::streambuf
+    {
+    public:
+        RecordBuf() : truncated(false) {}
+
+        void reset(char* buffer, size_t size)
+        {
+            setp(buffer, buffer + size);
+            truncated = false;
+        }
+
+        size_t length() const { return pptr() - pbase(); }
+
+        bool truncated;
+
+    protected:
+        int_type overflow(int_type ch)
+        {
+            truncated = true;
+            return traits_type::not_eof(ch);
+        }
+
+        std::streamsize xsputn(const char* s, std::streamsize n)
+        {
+            std::streamsize room = epptr() - pptr();
+            std::streamsize copied = (n < room) ? n : room;
+            memcpy(pptr(), s, copied);
+            pbump((int)copied);
+            if (copied < n)
+                truncated = true;
+            return n;
+        }
+    };
+
+    // one producer (the owning thread), one consumer (whoever holds
+    // s_Working_Drain); head and tail count records, they never wrap
+    struct Ring_t
+    {
+        Ring_t() : head(0), tail(0), dropped(0), inUse(true), writing(false), stream(&buf), current(0) {}
+
+        std::atomic<uint64_t> head;
+        char                  pad0[64 - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t> tail;
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool>     inUse;     // false once the owning thread exited
+        std::atomic<bool>     writing;   // between Begin and Commit, see Stop
+        char                  pad1[64];
+
+        AsyncLog::Record_t    slots[ASYNC_LOG_RING_SLOTS];
+
+        // producer only
+        RecordBuf             buf;
+        std::ostream          stream;
+        AsyncLog::Record_t*   current;
+    };
+
+    // background writer; drain() also serves Flush and Stop
+    class LogWriter
+    {
+    public:
+        LogWriter() : reported(0) {}
+
+        bool drain();
+
+        uint64_t reported;
+
+    private:
+        std::vector<Ring_t*> rings;
+        std::vector<uint64_t> cursors;
+        struct iovec iov[2 * ASYNC_LOG_WRITE_BATCH + 1];
+        char prefixes[ASYNC_LOG_WRITE_BATCH][96];
+        char notice[160];
+
+        void writeAll(struct iovec* vec, int count);
+    };
+
+    pthread_mutex_t s_Working_Rings = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t s_Working_Drain = PTHREAD_MUTEX_INITIALIZER;
+
+    // rings outlive their threads and are handed to new ones once drained
+    std::vector<Ring_t*> s_Rings;
+    pthread_key_t s_RingKey;
+    pthread_once_t s_RingKeyOnce = PTHREAD_ONCE_INIT;
+    __thread Ring_t* t_Ring = 0;
+
+    LogWriter s_Writer;
+
+    // serializes Start and Stop; producers never take it
+    pthread_mutex_t s_Working_Writer = PTHREAD_MUTEX_INITIALIZER;
+
+    // created on first use and never deleted: a producer may call Wake()
+    // at any time, even while Stop joins the thread or after it has, and
+    // the thread (with its eventfd) must still be there.  Stop only stops
+    // it and Start runs it again.
+    WorkerThread* writerThread()
+    {
+        static WorkerThread* thread = new WorkerThread("AsyncLog");
+        return thread;
+    }
+
+    ICallback* writerStep()
+    {
+        static ICallback* step = new Callback0<LogWriter, bool>(&s_Writer, &LogWriter::drain);
+        return step;
+    }
+
+    void releaseRing(void* ring)
+    {
+        ((Ring_t*)ring)->inUse.store(false, std::memory_order_release);
+    }
+
+    void createRingKey()
+    {
+        pthread_key_create(&s_RingKey, releaseRing);
+    }
+
+    Ring_t* attachRing()
+    {
+        pthread_once(&s_RingKeyOnce, createRingKey);
+
+        Ring_t* ring = 0;
+        pthread_mutex_lock(&s_Working_Rings);
+        {
+            for (size_t i = 0; (i < s_Rings.size()) && (ring == 0); i++)
+            {
+                Ring_t* candidate = s_Rings[i];
+                if (!candidate->inUse.load(std::memory_order_acquire) &&
+                    (candidate->head.load(std::memory_order_acquire) == candidate->tail.load(std::memory_order_relaxed)))
+                {
+                    candidate->inUse.store(true, std::memory_order_relaxed);
+                    ring = candidate;
+                }
+            }
+
+            if (ring == 0)
+            {
+                ring = new Ring_t();
+                s_Rings.push_back(ring);
+            }
+        }
+        pthread_mutex_unlock(&s_Working_Rings);
+
+        pthread_setspecific(s_RingKey, ring);
+        t_Ring = ring;
+        return ring;
+    }
+}
+
+std::atomic<bool> AsyncLog::s_Active(false);
+
+bool AsyncLog::Start()
+{
+    bool started = true;
+    pthread_mutex_lock(&s_Working_Writer);
+    {
+        WorkerThread* thread = writerThread();
+        if (!thread->IsRunning())
+            started = thread->Start(writerStep(), ASYNC_LOG_PERIOD_S);
+
+        if (started)
+            s_Active.store(true);
+    }
+    pthread_mutex_unlock(&s_Working_Writer);
+    return started;
+}
+
+void AsyncLog::Stop()
+{
+    pthread_mutex_lock(&s_Working_Writer);
+    {
+        WorkerThread* thread = writerThread();
+        if (thread->IsRunning())
+        {
+            s_Active.store(false);
+
+            // a producer that got past the active check before it cleared
+            // commits its record before the last drain; any later one sees
+            // the flag and logs directly (see Begin)
+            std::vector<Ring_t*> rings;
+            pthread_mutex_lock(&s_Working_Rings);
+            {
+                rings = s_Rings;
+            }
+            pthread_mutex_unlock(&s_Working_Rings);
+
+            for (size_t i = 0; i < rings.size(); i++)
+            {
+                while (rings[i]->writing.load(std::memory_order_acquire))
+                    sched_yield();
+            }
+
+            thread->Stop();
+            Flush();
+        }
+    }
+    pthread_mutex_unlock(&s_Working_Writer);
+}
+
+void AsyncLog::Flush()
+{
+    while (s_Writer.drain())
+    {
+    }
+}
+
+uint64_t AsyncLog::Dropped()
+{
+    uint64_t dropped = 0;
+    pthread_mutex_lock(&s_Working_Rings);
+    {
+        for (size_t i = 0; i < s_Rings.size(); i++)
+            dropped += s_Rings[i]->dropped.load(std::memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&s_Working_Rings);
+    return dropped;
+}
+
+std::ostream* AsyncLog::Begin(const char* tag, const std::string& name, bool& stopped)
+{
+    Ring_t* ring = t_Ring ? t_Ring : attachRing();
+
+    // set before the active check, both seq_cst, so either Stop waits for
+    // this record or this sees Stop and returns NULL
+    ring->writing.store(true);
+    stopped = !s_Active.load();
+    if (stopped)
+    {
+        ring->writing.store(false, std::memory_order_release);
+        return NULL;
+    }
+
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t used = tail - ring->head.load(std::memory_order_acquire);
+    if (used >= ASYNC_LOG_RING_SLOTS)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        ring->writing.store(false, std::memory_order_release);
+        return NULL;
+    }
+
+    // don't wait for the writer's next period to make room
+    if (used == ASYNC_LOG_RING_SLOTS / 2)
+        writerThread()->Wake();
+
+    AsyncLog::Record_t& rec = ring->slots[tail & (ASYNC_LOG_RING_SLOTS - 1)];
+    clock_gettime(CLOCK_REALTIME, &rec.timestamp);
+    rec.tag = tag;
+
+    size_t nameLen = name.size() < sizeof(rec.name) - 1 ? name.size() : sizeof(rec.name) - 1;
+    memcpy(rec.name, name.data(), nameLen);
+    rec.name[nameLen] = 0;
+
+    // leave room for the newline; formatting state does not carry over
+    // from the previous record
+    ring->buf.reset(rec.text, sizeof(rec.text) - 1);
+    ring->stream.clear();
+    ring->stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    ring->stream.width(0);
+    ring->stream.precision(6);
+    ring->stream.fill(' ');
+    ring->current = &rec;
+
+    return &ring->stream;
+}
+
+void AsyncLog::Commit()
+{
+    Ring_t* ring = t_Ring;
+    AsyncLog::Record_t* rec = ring->current;
+
+    size_t length = ring->buf.length();
+    if (ring->buf.truncated && (length >= 3))
+        memcpy(rec->text + length - 3, "...", 3);
+    rec->text[length++] = '\n';
+    rec->length = (uint16_t)length;
+
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    ring->writing.store(false, std::memory_order_release);
+}
+
+//=============================================================================
+// LogWriter::drain
+//-----------------------------------------------------------------------------
+// Writes out everything committed so far, oldest record first across all
+// rings, ASYNC_LOG_WRITE_BATCH records per writev.  Returns true if it
+// wrote anything.
+//=============================================================================
+bool LogWriter::drain()
+{
+    bool wrote = false;
+
+    pthread_mutex_lock(&s_Working_Drain);
+    {
+        pthread_mutex_lock(&s_Working_Rings);
+        {
+            rings = s_Rings;
+        }
+        pthread_mutex_unlock(&s_Working_Rings);
+
+        cursors.resize(rings.size());
+        for (size_t i = 0; i < rings.size(); i++)
+            cursors[i] = rings[i]->head.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            int count = 0;
+            while (count < ASYNC_LOG_WRITE_BATCH)
+            {
+                // the oldest record at the head of any ring goes next
+                Ring_t* oldest = 0;
+                size_t which = 0;
+                const AsyncLog::Record_t* rec = 0;
+                for (size_t i = 0; i < rings.size(); i++)
+                {
+                    if (cursors[i] == rings[i]->tail.load(std::memory_order_acquire))
+                        continue;
+
+                    const AsyncLog::Record_t* head = &rings[i]->slots[cursors[i] & (ASYNC_LOG_RING_SLOTS - 1)];
+                    if ((rec == 0) ||
+                        (head->timestamp.tv_sec < rec->timestamp.tv_sec) ||
+                        ((head->timestamp.tv_sec == rec->timestamp.tv_sec) && (head->timestamp.tv_nsec < rec->timestamp.tv_nsec)))
+                    {
+                        oldest = rings[i];
+                        which = i;
+                        rec = head;
+                    }
+                }
+
+                if (oldest == 0)
+                    break;
+
+                int prefixLen = snprintf(prefixes[count], sizeof(prefixes[count]), "%s: (%-16s) %s",
+                                         Logger::FormatTimeStamp(rec->timestamp), rec->name, rec->tag);
+                if (prefixLen >= (int)sizeof(prefixes[count]))
+                    prefixLen = sizeof(prefixes[count]) - 1;
+
+                iov[2 * count].iov_base = prefixes[count];
+                iov[2 * count].iov_len = prefixLen;
+                iov[2 * count + 1].iov_base = (void*)rec->text;
+                iov[2 * count + 1].iov_len = rec->length;
+                cursors[which]++;
+                count++;
+            }
+
+            if (count == 0)
+                break;
+
+            writeAll(iov, 2 * count);
+            wrote = true;
+
+            // the slots can be reused once they are written
+            for (size_t i = 0; i < rings.size(); i++)
+                rings[i]->head.store(cursors[i], std::memory_order_release);
+        }
+
+        uint64_t dropped = 0;
+        for (size_t i = 0; i < rings.size(); i++)
+            dropped += rings[i]->dropped.load(std::memory_order_relaxed);
+
+        if (dropped > reported)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            int noticeLen = snprintf(notice, sizeof(notice), "%s: (%-16s) [WARN ] Dropped %llu log record(s), ring full\n",
+                                     Logger::FormatTimeStamp(now), "AsyncLog", (unsigned long long)(dropped - reported));
+            if (noticeLen >= (int)sizeof(notice))
+                noticeLen = sizeof(notice) - 1;
+
+            iov[0].iov_base = notice;
+            iov[0].iov_len = noticeLen;
+            writeAll(iov, 1);
+            reported = dropped;
+        }
+    }
+    pthread_mutex_unlock(&s_Working_Drain);
+
+    return wrote;
+}
+
+void LogWriter::writeAll(struct iovec* vec, int count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(STDERR_FILENO, vec, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;     // nowhere to report it
+        }
+
+        // skip what went out, a short write resumes mid-iovec
+        while ((count > 0) && ((size_t)written >= vec->iov_len))
+        {
+            written -= vec->iov_len;
+            vec++;
+            count--;
+        }
+        if (count > 0)
+        {
+            vec->iov_base = (char*)vec->iov_base + written;
+            vec->iov_len -= written;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/**************************************************************************
+*
+*		     Source:  AsyncLog.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Asynchronous backend for Logger.  While it is started, a
+*		    log call formats its message into the next record of the
+*		    calling thread's own lock-free ring (no locks, no flush,
+*		    no localtime) and returns.  A background thread merges
+*		    the rings by timestamp, adds the usual prefix and writes
+*		    them to stderr in batches with writev.  A full ring drops
+*		    new records (counted and reported) rather than block.
+*
+****************************************************************************/
+#ifndef __ASYNC_LOG_H__
+#define __ASYNC_LOG_H__
+
+#include <ostream>
+#include <string>
+#include <atomic>
+
+#include <stdint.h>
+#include <time.h>
+
+// Records per thread ring (power of 2)
+#define ASYNC_LOG_RING_SLOTS    512
+
+// Message text per record, longer messages are truncated
+#define ASYNC_LOG_RECORD_SIZE   480
+
+// Records per writev (two iovecs each)
+#define ASYNC_LOG_WRITE_BATCH   64
+
+// How often the writer looks for records when nobody wakes it
+#define ASYNC_LOG_PERIOD_S      0.01
+
+class AsyncLog
+{
+public:
+    struct Record_t
+    {
+        struct timespec timestamp;
+        const char*     tag;        // "[ERROR] " etc, a string literal
+        uint16_t        length;     // text bytes, including the newline
+        char            name[30];
+        char            text[ASYNC_LOG_RECORD_SIZE];
+    };
+
+    // Start routes every Logger to the backend; Stop writes out what is
+    // queued and routes them back to std::clog
+    static bool Start();
+    static void Stop();
+
+    // writes out every committed record before returning
+    static void Flush();
+
+    static bool Active() { return s_Active.load(std::memory_order_relaxed); }
+
+    // Producer side (Logger): Begin returns a stream over the next record
+    // of the calling thread's ring, or NULL if the ring is full (the record
+    // is dropped) or, with stopped set, if Stop has begun (log directly);
+    // Commit publishes what was written to it.
+    static std::ostream* Begin(const char* tag, const std::string& name, bool& stopped);
+    static void Commit();
+
+    // records dropped so far because a ring was full
+    static uint64_t Dropped();
+
+private:
+    static std::atomic<bool> s_Active;
+
+    AsyncLog();
+};
+
+#endif
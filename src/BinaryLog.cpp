@@ -0,0 +1,251 @@
+/**************************************************************************
+*
+*		     Source:  BinaryLog.cpp
+*           Project:  ScorpionServer
+*
+*            Author: trafferty
+*              Date: Oct 17, 2026
+*
+*		Description:
+*			> Binary trace log, see BinaryLog.h
+*
+****************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "BinaryLog.h"
+
+namespace
+{
+    struct Definition_t
+    {
+        uint16_t    id;
+        std::string argTypes;
+        std::string format;
+        std::string file;
+        int         line;
+    };
+
+    // every call site registered so far; written to the file on Open and
+    // as they come while it is open
+    std::vector<Definition_t> s_Definitions;
+    pthread_mutex_t s_Working_Definitions = PTHREAD_MUTEX_INITIALIZER;
+
+    int    s_Fd = -1;
+    char*  s_Map = 0;
+    size_t s_MapSize = 0;
+
+    uint64_t realtimeNs()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+
+    uint64_t monotonicNs()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+}
+
+std::atomic<bool>     BinaryLog::s_Active(false);
+std::atomic<uint64_t> BinaryLog::s_Offset(0);
+std::atomic<uint64_t> BinaryLog::s_FirstFull(UINT64_MAX);
+std::atomic<uint64_t> BinaryLog::s_Dropped(0);
+char*                 BinaryLog::s_Records = 0;
+uint64_t              BinaryLog::s_Capacity = 0;
+
+//=============================================================================
+// define
+//-----------------------------------------------------------------------------
+// Appends a definition record: BinaryLogRecord_t (id 0), the call site's
+// id, line and argument count, the argument types, then the file and the
+// format, each with a 16 bit length, then padding.
+//=============================================================================
+void BinaryLog::define(uint16_t id, const std::string& argTypes, const std::string& file, int line,
+                       const std::string& format)
+{
+    size_t size = recordSize(sizeof(BinaryLogRecord_t) + 2 + 4 + 2 + argTypes.size() +
+                             2 + file.size() + 2 + format.size());
+    char* out = reserve(size);
+    if (out == NULL)
+        return;
+
+    BinaryLogRecord_t* rec = (BinaryLogRecord_t*)out;
+    rec->id = 0;
+    rec->ticks = Ticks();
+
+    char* p = out + sizeof(BinaryLogRecord_t);
+    uint16_t numArgs = (uint16_t)argTypes.size();
+    uint16_t fileLen = (uint16_t)file.size();
+    uint16_t formatLen = (uint16_t)format.size();
+    int32_t lineNum = line;
+
+    memcpy(p, &id, 2);                         p += 2;
+    memcpy(p, &lineNum, 4);                    p += 4;
+    memcpy(p, &numArgs, 2);                    p += 2;
+    memcpy(p, argTypes.data(), numArgs);       p += numArgs;
+    memcpy(p, &fileLen, 2);                    p += 2;
+    memcpy(p, file.data(), fileLen);           p += fileLen;
+    memcpy(p, &formatLen, 2);                  p += 2;
+    memcpy(p, format.data(), formatLen);
+
+    __atomic_store_n(&rec->size, (uint16_t)size, __ATOMIC_RELEASE);
+}
+
+bool BinaryLog::Open(const std::string& path, size_t sizeMB)
+{
+    if (s_Fd != -1)
+        return false;
+
+    s_MapSize = sizeof(BinaryLogHeader_t) + sizeMB * 1024 * 1024;
+
+    s_Fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (s_Fd == -1)
+        return false;
+
+    // populated up front, so a record never waits on a page fault
+    if ((ftruncate(s_Fd, s_MapSize) != 0) ||
+        ((s_Map = (char*)mmap(NULL, s_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s_Fd, 0)) == MAP_FAILED))
+    {
+        s_Map = 0;
+        close(s_Fd);
+        s_Fd = -1;
+        return false;
+    }
+
+    // calibrate the timestamp counter against the clock for files that
+    // are never closed
+    uint64_t ns0 = monotonicNs();
+    uint64_t ticks0 = Ticks();
+    while (monotonicNs() - ns0 < 10000000ULL)
+    {
+    }
+    uint64_t ns1 = monotonicNs();
+    uint64_t ticks1 = Ticks();
+
+    BinaryLogHeader_t* header = (BinaryLogHeader_t*)s_Map;
+    memcpy(header->magic, BINARY_LOG_MAGIC, sizeof(header->magic));
+    header->capacity = s_MapSize - sizeof(BinaryLogHeader_t);
+    header->used = 0;
+    header->dropped = 0;
+    header->startNs = realtimeNs();
+    header->startTicks = Ticks();
+    header->endNs = 0;
+    header->endTicks = 0;
+    header->ticksPerNs = (double)(ticks1 - ticks0) / (double)(ns1 - ns0);
+
+    s_Records = s_Map + sizeof(BinaryLogHeader_t);
+    s_Capacity = header->capacity;
+    s_Offset = 0;
+    s_FirstFull = UINT64_MAX;
+    s_Dropped = 0;
+
+    pthread_mutex_lock(&s_Working_Definitions);
+    {
+        for (size_t i = 0; i < s_Definitions.size(); i++)
+        {
+            const Definition_t& def = s_Definitions[i];
+            define(def.id, def.argTypes, def.file, def.line, def.format);
+        }
+        s_Active.store(true);
+    }
+    pthread_mutex_unlock(&s_Working_Definitions);
+
+    return true;
+}
+
+//=============================================================================
+// full
+//-----------------------------------------------------------------------------
+// A reservation at offset did not fit.  Counts it and keeps the lowest such
+// offset, where Close stops waiting for records.
+//=============================================================================
+void BinaryLog::full(uint64_t offset)
+{
+    s_Dropped.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t first = s_FirstFull.load(std::memory_order_relaxed);
+    while ((offset < first) && !s_FirstFull.compare_exchange_weak(first, offset, std::memory_order_release))
+    {
+    }
+}
+
+//=============================================================================
+// Close
+//-----------------------------------------------------------------------------
+// Moves the offset past any capacity, so a tracer that still passed the
+// Active() check gets no room, then waits for every record that did get
+// room to be finished (its size is stored last) before unmapping.
+// Reservations tile the file from 0, so a position whose size stays 0 can
+// only be the first one that did not fit.  Tracing costs nothing extra.
+//=============================================================================
+void BinaryLog::Close()
+{
+    if (s_Fd == -1)
+        return;
+
+    s_Active.store(false);
+    uint64_t reserved = s_Offset.exchange(UINT64_MAX / 2);
+
+    uint64_t used = 0;
+    while ((used < reserved) && (used + sizeof(BinaryLogRecord_t) <= s_Capacity))
+    {
+        BinaryLogRecord_t* rec = (BinaryLogRecord_t*)(s_Records + used);
+        uint16_t size = __atomic_load_n(&rec->size, __ATOMIC_ACQUIRE);
+        if (size != 0)
+        {
+            used += size;
+            continue;
+        }
+        if (s_FirstFull.load(std::memory_order_acquire) <= used)
+            break;
+        sched_yield();
+    }
+
+    BinaryLogHeader_t* header = (BinaryLogHeader_t*)s_Map;
+    header->endNs = realtimeNs();
+    header->endTicks = Ticks();
+    header->used = used;
+    header->dropped = s_Dropped.load();
+
+    munmap(s_Map, s_MapSize);
+    if (ftruncate(s_Fd, sizeof(BinaryLogHeader_t) + used) != 0)
+    {
+        // the decoder stops at the first unwritten record anyway
+    }
+    close(s_Fd);
+
+    s_Map = 0;
+    s_Records = 0;
+    s_Capacity = 0;
+    s_Fd = -1;
+}
+
+uint16_t BinaryLog::Register(const char* format, const char* file, int line, const char* argTypes)
+{
+    Definition_t def;
+    def.argTypes = argTypes;
+    def.format = format;
+    def.file = file;
+    def.line = line;
+
+    pthread_mutex_lock(&s_Working_Definitions);
+    {
+        // id 0 marks definitions
+        def.id = (uint16_t)(s_Definitions.size() + 1);
+        s_Definitions.push_back(def);
+
+        if (s_Active)
+            define(def.id, def.argTypes, def.file, def.line, def.format);
+    }
+    pthread_mutex_unlock(&s_Working_Definitions);
+
+    return def.id;
+}
@@ -0,0 +1,245 @@
+/**************************************************************************
+*
+*		     Source:  BinaryLog.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Binary trace log for hot paths (NanoLog style).  Each
+*		    LOG_TRACE call site registers its printf format once and
+*		    gets a static id; a record is then only the id, a TSC
+*		    timestamp and the raw argument values, copied into a
+*		    memory-mapped file.  Nothing is formatted at run time,
+*		    bin/log_decode turns the file back into text.  When the
+*		    file is full further records are dropped and counted.
+*
+*		    File layout: BinaryLogHeader_t, then records.  Every
+*		    record starts with BinaryLogRecord_t; id 0 is a format
+*		    definition (id, argument types, line, file, format),
+*		    any other id is a trace record followed by its arguments
+*		    (8 bytes each, strings as a 16 bit length plus the bytes).
+*		    Every record is padded to a multiple of
+*		    BINARY_LOG_ALIGN bytes, and its size includes the
+*		    padding, so each one (and its 64 bit fields) starts
+*		    aligned.
+*
+****************************************************************************/
+#ifndef __BINARY_LOG_H__
+#define __BINARY_LOG_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Default file size ("binary_log_mb" in the config)
+#define BINARY_LOG_SIZE_MB      64
+
+// Longest string argument kept, longer ones are truncated
+#define BINARY_LOG_MAX_STRING   1024
+
+#define BINARY_LOG_MAGIC        "SBINLOG1"
+
+// Record alignment (power of 2)
+#define BINARY_LOG_ALIGN        8
+
+struct BinaryLogHeader_t
+{
+    char     magic[8];
+    uint64_t capacity;          // record bytes after the header
+    uint64_t used;              // record bytes written, set by Close
+    uint64_t dropped;           // records that did not fit, set by Close
+    uint64_t startNs;           // CLOCK_REALTIME at Open ...
+    uint64_t startTicks;        // ... and the timestamp counter with it
+    uint64_t endNs;             // same at Close (0 if it never closed)
+    uint64_t endTicks;
+    double   ticksPerNs;        // measured at Open, for unclosed files
+};
+
+struct BinaryLogRecord_t
+{
+    uint16_t size;              // whole record with padding, written last (0: unfinished)
+    uint16_t id;                // 0: format definition
+    uint32_t reserved;
+    uint64_t ticks;
+};
+
+// argument type codes, as stored in a definition
+enum BinaryLogArg_t
+{
+    BINLOG_ARG_INT    = 'i',
+    BINLOG_ARG_UINT   = 'u',
+    BINLOG_ARG_DOUBLE = 'f',
+    BINLOG_ARG_STRING = 's',
+    BINLOG_ARG_PTR    = 'p'
+};
+
+class BinaryLog
+{
+public:
+    // Open maps a file of sizeMB and starts taking records; Close stops
+    // handing out room, waits for the records already started, then trims
+    // the file and records the totals
+    static bool Open(const std::string& path, size_t sizeMB = BINARY_LOG_SIZE_MB);
+    static void Close();
+
+    static bool Active() { return s_Active.load(std::memory_order_relaxed); }
+
+    // Register: called once per call site (see LOG_TRACE), returns its id
+    static uint16_t Register(const char* format, const char* file, int line, const char* argTypes);
+
+    template <typename... Args> static const char* ArgTypes(const Args&...)
+    {
+        static const char types[] = { (char)Arg<typename std::decay<Args>::type>::type..., 0 };
+        return types;
+    }
+
+    template <typename... Args> static void Write(uint16_t id, const Args&... args)
+    {
+        size_t size = recordSize(sizeof(BinaryLogRecord_t) + argsSize(args...));
+        char* out = reserve(size);
+        if (out == NULL)
+            return;
+
+        BinaryLogRecord_t* rec = (BinaryLogRecord_t*)out;
+        rec->id = id;
+        rec->ticks = Ticks();
+        putArgs(out + sizeof(BinaryLogRecord_t), args...);
+
+        // the decoder stops at a record whose size is still 0
+        __atomic_store_n(&rec->size, (uint16_t)size, __ATOMIC_RELEASE);
+    }
+
+    static uint64_t Ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+    }
+
+    static uint64_t Dropped() { return s_Dropped.load(std::memory_order_relaxed); }
+
+private:
+    static std::atomic<bool>     s_Active;
+    static std::atomic<uint64_t> s_Offset;
+    static std::atomic<uint64_t> s_FirstFull;
+    static std::atomic<uint64_t> s_Dropped;
+    static char*                 s_Records;
+    static uint64_t              s_Capacity;
+
+    // bytes rounded up so the next record stays aligned
+    static size_t recordSize(size_t bytes)
+    {
+        return (bytes + BINARY_LOG_ALIGN - 1) & ~(size_t)(BINARY_LOG_ALIGN - 1);
+    }
+
+    // space for one record of recordSize() bytes, NULL (and counted) once
+    // the file is full
+    static char* reserve(size_t size)
+    {
+        uint64_t offset = s_Offset.fetch_add(size, std::memory_order_relaxed);
+        if (offset + size > s_Capacity)
+        {
+            full(offset);
+            return NULL;
+        }
+        return s_Records + offset;
+    }
+
+    static void full(uint64_t offset);
+
+    static void define(uint16_t id, const std::string& argTypes, const std::string& file, int line,
+                       const std::string& format);
+
+    // how each argument type is stored; anything else does not compile
+    template <typename T, typename Enable = void> struct Arg;
+
+    static size_t argsSize() { return 0; }
+
+    template <typename First, typename... Rest> static size_t argsSize(const First& first, const Rest&... rest)
+    {
+        return Arg<typename std::decay<First>::type>::size(first) + argsSize(rest...);
+    }
+
+    static void putArgs(char*) {}
+
+    template <typename First, typename... Rest> static void putArgs(char* out, const First& first, const Rest&... rest)
+    {
+        putArgs(Arg<typename std::decay<First>::type>::put(out, first), rest...);
+    }
+
+    static char* put64(char* out, const void* value)
+    {
+        memcpy(out, value, 8);
+        return out + 8;
+    }
+
+    // NULL is stored as "(null)", like printf's %s
+    static size_t stringSize(const char* s)
+    {
+        return 2 + strnlen(s ? s : "(null)", BINARY_LOG_MAX_STRING);
+    }
+
+    static char* putString(char* out, const char* s)
+    {
+        if (s == NULL)
+            s = "(null)";
+        uint16_t len = (uint16_t)strnlen(s, BINARY_LOG_MAX_STRING);
+        memcpy(out, &len, 2);
+        memcpy(out + 2, s, len);
+        return out + 2 + len;
+    }
+
+    BinaryLog();
+};
+
+template <typename T> struct BinaryLog::Arg<T, typename std::enable_if<(std::is_integral<T>::value && std::is_signed<T>::value) || std::is_enum<T>::value>::type>
+{
+    enum { type = BINLOG_ARG_INT };
+    static size_t size(T) { return 8; }
+    static char* put(char* out, T value) { int64_t v = (int64_t)value; return put64(out, &v); }
+};
+
+template <typename T> struct BinaryLog::Arg<T, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type>
+{
+    enum { type = BINLOG_ARG_UINT };
+    static size_t size(T) { return 8; }
+    static char* put(char* out, T value) { uint64_t v = (uint64_t)value; return put64(out, &v); }
+};
+
+template <typename T> struct BinaryLog::Arg<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    enum { type = BINLOG_ARG_DOUBLE };
+    static size_t size(T) { return 8; }
+    static char* put(char* out, T value) { double v = (double)value; return put64(out, &v); }
+};
+
+template <> struct BinaryLog::Arg<const char*>
+{
+    enum { type = BINLOG_ARG_STRING };
+    static size_t size(const char* s) { return stringSize(s); }
+    static char* put(char* out, const char* s) { return putString(out, s); }
+};
+
+template <> struct BinaryLog::Arg<char*> : BinaryLog::Arg<const char*>
+{
+};
+
+template <typename T> struct BinaryLog::Arg<T*>
+{
+    enum { type = BINLOG_ARG_PTR };
+    static size_t size(const T*) { return 8; }
+    static char* put(char* out, const T* p) { uint64_t v = (uint64_t)(uintptr_t)p; return put64(out, &v); }
+};
+
+#endif
@@ -69,7 +69,7 @@ class Callback0: public ICallback
       m_ReturnValue = (m_ClassType->*m_MemberFunction0)();
    }
 
-   virtual void Invoke(void *a1, void *a2 = 0)
+   virtual void Invoke(void *a1 __attribute__((unused)), void *a2 __attribute__((unused)) = 0)
    {
       Invoke();
    }
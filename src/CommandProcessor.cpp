@@ -21,8 +21,10 @@
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
 
 using namespace google::protobuf::io;
+using google::protobuf::internal::WireFormatLite;
 
 
 CommandProcessor::CommandProcessor(bool debug) :
@@ -33,23 +35,70 @@ CommandProcessor::CommandProcessor(bool debug) :
    m_buildStats(""),
    m_Socket(nullptr),
    m_Transport(nullptr),
-   m_latestResult(NULL)
+   m_ProgramWorker("ProgramLoop")
 {
    m_Log = std::shared_ptr<Logger>(new Logger(m_Name, m_Debug));
 
-   pthread_mutex_init(&m_Working_CommandFIFO, NULL);
    pthread_mutex_init(&m_Working_Program, NULL);
-   pthread_mutex_init(&m_Working_Results, NULL);
+   pthread_mutex_init(&m_Working_State, NULL);
+   pthread_mutex_init(&m_Working_Subscribers, NULL);
+   pthread_mutex_init(&m_Working_Parked, NULL);
+   m_ParkedQueries.reserve(PARKED_QUERY_LIMIT);
+   m_ParkedCount = 0;
+
+   m_IdleWorkers = 0;
+   m_MaxQueueDelayNs = 0;
+   m_Shed = 0;
+   m_Expired = 0;
+   for (int lane = 0; lane < NUM_LANES; lane++)
+   {
+      m_LaneWait[lane].executed = 0;
+      m_LaneWait[lane].totalNs = 0;
+      m_LaneWait[lane].maxNs = 0;
+   }
+   pthread_cond_init(&m_StateChanged, NULL);
+
+   m_ProgramStep = new Callback0<CommandProcessor, bool>(this, &CommandProcessor::programLoop);
 
-   m_callback = new Callback2<CommandProcessor, bool, intptr_t, void*>(this, &CommandProcessor::recvCBRoutine, 0, 0);
-   m_ICallbackPtr = m_callback;
+   registerHandlers();
 
-   m_latestResult = std::shared_ptr<sandbox::Response_Result>(new sandbox::Response_Result());
-   m_response     = std::shared_ptr<sandbox::Response>(new sandbox::Response());
+   m_connCallback = new Callback2<CommandProcessor, bool, intptr_t, void*>(this, &CommandProcessor::connCBRoutine, 0, 0);
+
+   m_RespPool = std::shared_ptr<MessagePool<sandbox::Response> >(new MessagePool<sandbox::Response>(RESPONSE_POOL_SIZE));
+   m_BatchPool = std::shared_ptr<MessagePool<sandbox::CommandBatch> >(new MessagePool<sandbox::CommandBatch>(BATCH_POOL_SIZE));
+   m_RespBatchPool = std::shared_ptr<MessagePool<sandbox::ResponseBatch> >(new MessagePool<sandbox::ResponseBatch>(BATCH_POOL_SIZE));
 }
 
 CommandProcessor::~CommandProcessor(void)
 {
+   m_ProgramWorker.Stop();
+   m_Workers.clear();
+   delete m_ProgramStep;
+}
+
+CommandProcessor::CommandWorker_t::CommandWorker_t(CommandProcessor* processor, int workerIndex,
+                                                   size_t controlSize, size_t dataSize) :
+   owner(processor),
+   index(workerIndex),
+   controlBurst(0),
+   idle(false),
+   executed(0),
+   stolen(0)
+{
+   std::stringstream name;
+   name << "ProcessCommands " << workerIndex;
+   thread = new WorkerThread(name.str());
+   step = new Callback0<CommandWorker_t, bool>(this, &CommandWorker_t::run);
+
+   lanes[LANE_CONTROL] = std::shared_ptr<MPMCQueue<PendingCommand_t> >(new MPMCQueue<PendingCommand_t>(controlSize));
+   lanes[LANE_DATA] = std::shared_ptr<MPMCQueue<PendingCommand_t> >(new MPMCQueue<PendingCommand_t>(dataSize));
+}
+
+CommandProcessor::CommandWorker_t::~CommandWorker_t()
+{
+   thread->Stop();
+   delete thread;
+   delete step;
 }
 
 bool CommandProcessor::init(cJSON* config)
@@ -70,11 +119,105 @@ bool CommandProcessor::init(cJSON* config)
       m_exit_on_quit = true;
    }
 
-   m_Socket = std::shared_ptr<ISocket>(new LinuxSocket("ClientSocket", m_Debug));
-   if (m_Socket->init(ISocket::ConnectionMode_t::CONN_MODE_SERVER, ipAddress.c_str(), port) == false)
+   // async_log: log calls only queue the message, a background thread
+   // writes them out (see AsyncLog.h); flushed in Shutdown
+   bool asyncLog = false;
+   getAttributeValue_Bool(config, "async_log", asyncLog);
+   if (asyncLog && !AsyncLog::Start())
    {
-      m_Log->LogError("Socket initialization failed");
-      return false;
+      m_Log->LogWarn("Unable to start the async log writer, logging synchronously");
+   }
+
+   // binary_log: LOG_TRACE points write to this file (see BinaryLog.h,
+   // decode with bin/log_decode); closed in Shutdown
+   string binaryLog;
+   if (getAttributeValue_String(config, "binary_log", binaryLog) && !binaryLog.empty())
+   {
+      int binaryLogMB;
+      if (!getAttributeValue_Int(config, "binary_log_mb", binaryLogMB) || (binaryLogMB <= 0))
+      {
+         binaryLogMB = BINARY_LOG_SIZE_MB;
+      }
+
+      if (!BinaryLog::Open(binaryLog, binaryLogMB))
+      {
+         m_Log->LogWarn("Unable to open binary log ", binaryLog, ", tracing is off");
+      }
+   }
+
+   int cmdQueueSize;
+   if (!getAttributeValue_Int(config, "cmd_queue_size", cmdQueueSize) || (cmdQueueSize <= 0))
+   {
+      cmdQueueSize = CMD_QUEUE_SIZE;
+   }
+   int controlQueueSize;
+   if (!getAttributeValue_Int(config, "control_queue_size", controlQueueSize) || (controlQueueSize <= 0))
+   {
+      controlQueueSize = CONTROL_QUEUE_SIZE;
+   }
+
+   // command_threads: handler threads, commands run in parallel across
+   // connections.  With more than one, an idle thread also steals data
+   // commands (query, data-only batches) from busy ones, so a connection's
+   // data commands can run concurrently with its later commands and their
+   // replies can come back out of order; a client that pipelines must
+   // match replies by id.  Control commands keep their order.  1 (the
+   // default) keeps every connection's replies in order.
+   int commandThreads;
+   if (!getAttributeValue_Int(config, "command_threads", commandThreads) || (commandThreads <= 0))
+   {
+      commandThreads = COMMAND_THREADS;
+   }
+   else if (commandThreads > MAX_COMMAND_THREADS)
+   {
+      m_Log->LogWarn("command_threads ", commandThreads, " is too many, using ", MAX_COMMAND_THREADS);
+      commandThreads = MAX_COMMAND_THREADS;
+   }
+
+   m_Workers.clear();
+   for (int i = 0; i < commandThreads; i++)
+      m_Workers.push_back(std::shared_ptr<CommandWorker_t>(new CommandWorker_t(this, i, controlQueueSize, cmdQueueSize)));
+
+   m_CmdPool = std::shared_ptr<MessagePool<sandbox::Command> >(new MessagePool<sandbox::Command>(
+                  commandThreads * (m_Workers[0]->lanes[LANE_CONTROL]->capacity() + m_Workers[0]->lanes[LANE_DATA]->capacity())));
+
+   // max_queue_delay_ms: shed data commands that waited longer than this
+   // in the queue, their clients have most likely given up (0: off)
+   int maxQueueDelay_ms;
+   if (getAttributeValue_Int(config, "max_queue_delay_ms", maxQueueDelay_ms) && (maxQueueDelay_ms > 0))
+   {
+      m_MaxQueueDelayNs = (uint64_t)maxQueueDelay_ms * 1000000ULL;
+   }
+
+   // socket_backend: "epoll" (LinuxSocket, default) or "io_uring"
+   string socketBackend;
+   if (!getAttributeValue_String(config, "socket_backend", socketBackend))
+   {
+      socketBackend = "epoll";
+   }
+
+   if (socketBackend == "io_uring")
+   {
+      m_Socket = std::shared_ptr<ISocket>(new IoUringSocket("ClientSocket", m_Debug));
+      if (m_Socket->init(ISocket::ConnectionMode_t::CONN_MODE_SERVER, ipAddress.c_str(), port) == false)
+      {
+         m_Log->LogWarn("io_uring socket initialization failed, falling back to epoll");
+         m_Socket = nullptr;
+      }
+   }
+   else if (socketBackend != "epoll")
+   {
+      m_Log->LogWarn("Unknown socket_backend '", socketBackend, "', using epoll");
+   }
+
+   if (m_Socket == nullptr)
+   {
+      m_Socket = std::shared_ptr<ISocket>(new LinuxSocket("ClientSocket", m_Debug));
+      if (m_Socket->init(ISocket::ConnectionMode_t::CONN_MODE_SERVER, ipAddress.c_str(), port) == false)
+      {
+         m_Log->LogError("Socket initialization failed");
+         return false;
+      }
    }
 
    //m_Socket->RegisterRecvCallback(23, m_ICallbackPtr);
@@ -87,8 +230,31 @@ bool CommandProcessor::init(cJSON* config)
       return false;
    }
 
-   m_Transport->RegisterRecvCallback(23, m_ICallbackPtr);
+   m_Transport->RegisterRecvCallback(23, SocketTransport::RecvDelegate_t::Bind<CommandProcessor, &CommandProcessor::recvCBRoutine>(this));
+   m_Transport->RegisterConnectionCallback(24, m_connCallback);
+
+   // framing: "delimited" (varint length prefix, default) or "line"
+   string framing;
+   if (getAttributeValue_String(config, "framing", framing) && (framing == "line"))
+   {
+      m_Transport->SetFramingMode(SocketTransport::FRAMING_LINE);
+   }
+   else
+   {
+      m_Transport->SetFramingMode(SocketTransport::FRAMING_DELIMITED);
+   }
 
+   // publish_policy: what happens to pushes for a subscriber that is not
+   // keeping up, "conflate" (default), "block" or "disconnect"; the
+   // subscribe command can override it per connection.  Both socket
+   // backends report a slow reader, so all three work with either one
+   string publishPolicy;
+   m_PublishPolicy = SocketTransport::PUBLISH_CONFLATE;
+   if (getAttributeValue_String(config, "publish_policy", publishPolicy) &&
+       !parsePublishPolicy(publishPolicy, m_PublishPolicy))
+   {
+      m_Log->LogWarn("Unknown publish_policy '", publishPolicy, "', using conflate");
+   }
 
    cJSON* imgEngine_config = cJSON_GetObjectItem(config, "imgEngine");
    if (imgEngine_config == NULL)
@@ -112,70 +278,155 @@ bool CommandProcessor::init(cJSON* config)
    return true;
 }
 
-bool CommandProcessor::recvCBRoutine(intptr_t replyID, void* CBMsg)
+bool CommandProcessor::recvCBRoutine(int replyID, const char* data, int numBytes)
 {
-   //char* buffer = static_cast<char*>(CBMsg);
-   //sandbox::Command cmd = decodeBuffer(buffer);
+   // push on the FIFO; replyID is the connection the command came in on
+   PendingCommand_t pending;
+   pending.connID = replyID;
+   pending.cmd = NULL;
+   pending.batch = NULL;
 
-   std::shared_ptr<sandbox::Command> cmd = std::shared_ptr<sandbox::Command>(new sandbox::Command);
+   if (isCommandBatch(data, numBytes))
+   {
+      pending.batch = m_BatchPool->Acquire();
+      if (!decodeBuffer(data, numBytes, *pending.batch))
+      {
+         m_Log->LogWarn("Unable to parse ", numBytes, " byte command batch from connection ", replyID);
+         rejectCommand(pending, sandbox::Response_Status_ERROR, false);
+         return false;
+      }
 
-   std::string &strCBMsg = *static_cast<std::string*>(CBMsg);
+      LOG_DEBUG(m_Log, "Reply ID: ", replyID, " batch of ", pending.batch->commands_size(), "->", pending.batch->DebugString());
+   }
+   else
+   {
+      pending.cmd = m_CmdPool->Acquire();
+      if (!decodeBuffer(data, numBytes, *pending.cmd))
+      {
+         m_Log->LogWarn("Unable to parse ", numBytes, " byte command from connection ", replyID);
+         rejectCommand(pending, sandbox::Response_Status_ERROR, false);
+         return false;
+      }
 
-   cmd->ParseFromString(strCBMsg);
+      // DebugString() builds a string, only pay for it when it gets printed
+      LOG_DEBUG(m_Log, "Reply ID: ", replyID, " msg size: ", pending.cmd->ByteSizeLong(), "->", pending.cmd->DebugString());
+   }
 
-   //std::string &strCBMsg = *static_cast<std::string*>(CBMsg);
-   //string strCBMsg(CBMsg);
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   pending.queuedNs = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
 
-   m_Log->LogDebug("Reply ID: ", replyID, " msg size: ", cmd->ByteSize(), "->", cmd->DebugString());
+   // a connection sticks to one worker
+   CommandWorker_t& worker = *m_Workers[(unsigned)pending.connID % m_Workers.size()];
 
-   // push on the FIFO
-   pthread_mutex_lock(&m_Working_CommandFIFO);
+   Lane_t lane = laneOf(pending);
+   bool wasEmpty = false;
+   if (!worker.lanes[lane]->Push(pending, &wasEmpty))
    {
-      m_CmdFIFO.push_back(cmd);
+      m_Log->LogWarn("Command FIFO full (", worker.lanes[lane]->capacity(), "), rejecting ",
+                     (pending.batch != NULL) ? "batch" : "command", " from connection ", replyID);
+      // the RX thread serves every connection, it must not wait for this one
+      rejectCommand(pending, sandbox::Response_Status_OVERLOADED, false);
+      return false;
    }
-   pthread_mutex_unlock(&m_Working_CommandFIFO);
+
+   // a worker only sleeps once it has found every lane empty; if this one
+   // is busy, let an idle one steal
+   if (wasEmpty)
+      worker.thread->Wake();
+
+   // pairs with the fence in goIdle: either this sees the idle worker,
+   // or it sees the command just pushed
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if ((lane == LANE_DATA) && (m_IdleWorkers > 0) && !worker.idle.load(std::memory_order_relaxed))
+      wakeIdleWorker();
 
    return true;
 }
 
-sandbox::Command decodeBuffer(char* buffer  __attribute__((unused)))
-{
-   sandbox::Command cmd;
-//   int bytecount=0;
-//
-//   google::protobuf::uint32 size;
-//   google::protobuf::io::ArrayInputStream ais(buffer, 4);
-//   CodedInputStream coded_input(&ais);
-//   coded_input.ReadVarint32(&size);//Decode the HDR and get the size
-//   cout << "size of payload is " << size << endl;
-//
-//   //Assign ArrayInputStream with enough memory
-//   google::protobuf::io::ArrayInputStream ais(buffer, size+4);
-//   CodedInputStream coded_input(&ais);
-//
-//   //Read an unsigned integer with Varint encoding, truncating to 32 bits.
-//   coded_input.ReadVarint32(&size);
-//
-//   //After the message's length is read, PushLimit() is used to prevent the CodedInputStream
-//   //from reading beyond that length.Limits are used when parsing length-delimited
-//   //embedded messages
-//   google::protobuf::io::CodedInputStream::Limit msgLimit = coded_input.PushLimit(size);
-//
-//   //De-Serialize
-//   cmd.ParseFromCodedStream(&coded_input);
-//
-//   //Once the embedded message has been parsed, PopLimit() is called to undo the limit
-//    coded_input.PopLimit(msgLimit);
-//
-   return cmd;
-}
-
-bool CommandProcessor::doWork()
-{
-   if (m_Running)
-      return processCommands();
+//=============================================================================
+// rejectCommand
+//-----------------------------------------------------------------------------
+// Answers a command (or every command of a batch) that will not be run
+// with success FALSE and status, and releases it.  For a frame that did
+// not parse, that is whatever ids were read before the error.  Unless mayWait, the
+// reply is dropped if the connection is backed up rather than waited for.
+//=============================================================================
+void CommandProcessor::rejectCommand(PendingCommand_t& pending, sandbox::Response_Status status, bool mayWait)
+{
+   if (pending.batch != NULL)
+   {
+      sandbox::ResponseBatch* replies = m_RespBatchPool->Acquire();
+      for (int i = 0; i < pending.batch->commands_size(); i++)
+      {
+         sandbox::Response* response = replies->add_responses();
+         response->set_id(pending.batch->commands(i).id());
+         response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+         response->mutable_result()->set_status(status);
+      }
+      if (mayWait)
+         m_Transport->TransmitFrame(pending.connID, *replies);
+      else
+         m_Transport->TryTransmitFrame(pending.connID, *replies);
+      m_RespBatchPool->Release(replies);
+      m_BatchPool->Release(pending.batch);
+   }
    else
-      return false;
+   {
+      sandbox::Response* response = m_RespPool->Acquire();
+      response->set_id(pending.cmd->id());
+      response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+      response->mutable_result()->set_status(status);
+      if (mayWait)
+         m_Transport->TransmitFrame(pending.connID, *response);
+      else
+         m_Transport->TryTransmitFrame(pending.connID, *response);
+      m_RespPool->Release(response);
+      m_CmdPool->Release(pending.cmd);
+   }
+}
+
+// ttl_ms counts from when the command was queued
+static bool isExpired(const sandbox::Command& cmd, uint64_t waitNs)
+{
+   return cmd.has_ttl_ms() && (waitNs > (uint64_t)cmd.ttl_ms() * 1000000ULL);
+}
+
+//=============================================================================
+// isCommandBatch
+//-----------------------------------------------------------------------------
+// A CommandBatch starts with its commands field, which no Command field
+// shares, so the first tag is enough to tell them apart.
+//=============================================================================
+bool CommandProcessor::isCommandBatch(const char* buffer, int size)
+{
+   CodedInputStream coded_input((const google::protobuf::uint8*)buffer, size);
+   uint32_t tag = coded_input.ReadTag();
+
+   return (WireFormatLite::GetTagFieldNumber(tag) == sandbox::CommandBatch::kCommandsFieldNumber);
+}
+
+//=============================================================================
+// decodeBuffer
+//-----------------------------------------------------------------------------
+// Parses one frame payload (the transport has already stripped the length
+// prefix) without copying it out of the receive buffer.
+//=============================================================================
+bool CommandProcessor::decodeBuffer(const char* buffer, int size, google::protobuf::MessageLite& msg)
+{
+   CodedInputStream coded_input((const google::protobuf::uint8*)buffer, size);
+
+   //PushLimit() is used to prevent the CodedInputStream from reading beyond
+   //the frame
+   CodedInputStream::Limit msgLimit = coded_input.PushLimit(size);
+
+   //De-Serialize
+   bool ok = msg.ParseFromCodedStream(&coded_input) && coded_input.ConsumedEntireMessage();
+
+   //Once the embedded message has been parsed, PopLimit() is called to undo the limit
+   coded_input.PopLimit(msgLimit);
+
+   return ok;
 }
 
 bool CommandProcessor::Start()
@@ -186,25 +437,33 @@ bool CommandProcessor::Start()
       return false;
    }
 
-   m_Log->LogDebug("Using internal worker thread...");
+   m_Log->LogDebug("Using internal worker threads...");
 
    m_Log->LogDebug("Initializing random generator...");
    std::srand(std::time(0)); // use current time as seed for random generator
 
-   m_ThreadHelper.method = &CommandProcessor::programLoop;
-   m_ThreadHelper.obj = (this);
-   m_ThreadHelper.Done = false;
-   m_ThreadHelper.SleepTime_us = 500;
+   setRunning(true);
 
-   // create the RX Thread
-   if (pthread_create(&(m_ThreadHelper.thread_handle), 0,
-         CommandProcessor::thread_func, (void *)&m_ThreadHelper) != 0)
+   if (!m_ProgramWorker.Start(m_ProgramStep, PROGRAM_LOOP_PERIOD_S))
    {
-      m_Log->LogError("Error spawning ProcessCommands thread");
+      m_Log->LogError("Error spawning ProgramLoop thread");
+      setRunning(false);
       return false;
    }
 
-   m_Running = true;
+   for (size_t i = 0; i < m_Workers.size(); i++)
+   {
+      if (!m_Workers[i]->thread->Start(m_Workers[i]->step))
+      {
+         m_Log->LogError("Error spawning ProcessCommands thread ", i);
+         for (size_t j = 0; j < i; j++)
+            m_Workers[j]->thread->Stop();
+         m_ProgramWorker.Stop();
+         setRunning(false);
+         return false;
+      }
+   }
+   m_Log->LogInfo("Running commands on ", m_Workers.size(), " worker thread(s)");
 
    return true;
 }
@@ -214,153 +473,804 @@ bool CommandProcessor::IsRunning()
    return m_Running;
 }
 
+void CommandProcessor::setRunning(bool running)
+{
+   pthread_mutex_lock(&m_Working_State);
+   {
+      m_Running = running;
+      pthread_cond_broadcast(&m_StateChanged);
+   }
+   pthread_mutex_unlock(&m_Working_State);
+}
+
+bool CommandProcessor::WaitForShutdown(double timeout_s)
+{
+   struct timespec deadline;
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   long long nsec = deadline.tv_nsec + (long long)(timeout_s * 1e9);
+   deadline.tv_sec += nsec / 1000000000LL;
+   deadline.tv_nsec = nsec % 1000000000LL;
+
+   bool running;
+   pthread_mutex_lock(&m_Working_State);
+   {
+      while (m_Running)
+      {
+         if (pthread_cond_timedwait(&m_StateChanged, &m_Working_State, &deadline) != 0)
+            break;
+      }
+      running = m_Running;
+   }
+   pthread_mutex_unlock(&m_Working_State);
+
+   return running;
+}
+
 bool CommandProcessor::Shutdown()
 {
-   m_Running = false;
-   m_ThreadHelper.Done = true;
-   m_Log->LogDebug("ProcessCommands thread stopped, shutting down comms...");
+   setRunning(false);
+   m_ProgramWorker.Stop();
+   m_Log->LogDebug("ProgramLoop thread stopped, shutting down comms...");
 
    m_Transport->StopComm();
 
    m_Log->LogDebug("Waiting for join...");
-   pthread_join(m_ThreadHelper.thread_handle, NULL);
+   for (size_t i = 0; i < m_Workers.size(); i++)
+      m_Workers[i]->thread->Stop();
+
+   // commands still queued will not be answered
+   PendingCommand_t pending;
+   for (size_t i = 0; i < m_Workers.size(); i++)
+   {
+      for (int lane = 0; lane < NUM_LANES; lane++)
+      {
+         while (m_Workers[i]->lanes[lane]->Pop(pending))
+         {
+            m_CmdPool->Release(pending.cmd);
+            m_BatchPool->Release(pending.batch);
+         }
+      }
+   }
+
+   pthread_mutex_lock(&m_Working_Parked);
+   {
+      m_ParkedQueries.clear();
+      m_ParkedCount = 0;
+   }
+   pthread_mutex_unlock(&m_Working_Parked);
+
+   static const char* laneNames[NUM_LANES] = { "control", "data" };
+   for (int lane = 0; lane < NUM_LANES; lane++)
+   {
+      LaneStats_t stats;
+      GetLaneStats((Lane_t)lane, stats);
+      m_Log->LogInfo("Command lane ", laneNames[lane], ": ", stats.executed, " processed, ", stats.rejected,
+                     " rejected, max depth ", stats.maxDepth, " of ", m_Workers[0]->lanes[lane]->capacity(),
+                     ", wait avg ", stats.avgWait_us, " us, max ", stats.maxWait_us, " us");
+   }
+
+   for (size_t i = 0; i < m_Workers.size(); i++)
+   {
+      m_Log->LogInfo("Command worker ", i, ": ", m_Workers[i]->executed.load(), " executed, ",
+                     m_Workers[i]->stolen.load(), " of them stolen");
+   }
+   m_Log->LogInfo("Commands shed after max_queue_delay_ms: ", m_Shed.load(), ", expired (ttl_ms): ", m_Expired.load());
+
+   SocketTransport::PublishStats_t pubStats = m_Transport->GetPublishStats();
+   m_Log->LogInfo("Published results: ", pubStats.published, " queued, ", pubStats.conflated, " conflated, ",
+                  pubStats.disconnected, " subscriber(s) disconnected");
+
+   if (BinaryLog::Active())
+   {
+      m_Log->LogInfo("Binary log dropped ", BinaryLog::Dropped(), " record(s)");
+      BinaryLog::Close();
+   }
+
+   // write out everything still queued and go back to logging directly
+   if (AsyncLog::Active())
+   {
+      m_Log->LogInfo("Async log dropped ", AsyncLog::Dropped(), " record(s)");
+      AsyncLog::Stop();
+   }
 
    return true;
 }
 
 bool CommandProcessor::programLoop()
 {
-   pthread_mutex_lock(&m_Working_Results);
+   ResultSnapshot_t result;
+   result.contact_radius  = std::rand()*0.76;
+   result.center_point[0] = std::rand()*0.06;
+   result.center_point[1] = std::rand()*0.16;
+
+   // everything but the id is set, so this serializes to exactly the
+   // bytes a query reply carries after it
+   uint64_t version = m_latestResult.Version() + 1;
+
+   m_ResultEncoder.Clear();
+   m_ResultEncoder.set_result_version(version);
+   m_ResultEncoder.mutable_result()->set_contact_radius(result.contact_radius);
+   m_ResultEncoder.mutable_result()->add_center_point(result.center_point[0]);
+   m_ResultEncoder.mutable_result()->add_center_point(result.center_point[1]);
+
+   size_t encodedSize = m_ResultEncoder.ByteSizeLong();
+   if (encodedSize <= RESULT_ENCODED_SIZE)
+   {
+      m_ResultEncoder.SerializeWithCachedSizesToArray((uint8_t*)result.encoded);
+      result.encodedSize = (uint32_t)encodedSize;
+   }
+   else
+   {
+      result.encodedSize = 0;
+   }
+
+   m_latestResult.Store(result);
+   publishResult(result, version);
+
+   // whichever worker is free answers the queries that were waiting for
+   // this one; with none idle, every worker checks after its current
+   // command (one just going idle finds the wake up pending)
+   if ((m_ParkedCount > 0) && !wakeIdleWorker())
+   {
+      for (size_t i = 0; i < m_Workers.size(); i++)
+         m_Workers[i]->thread->Wake();
+   }
+
+   // idle until the next period
+   return false;
+}
+
+//=============================================================================
+// registerHandlers
+//-----------------------------------------------------------------------------
+// Command methods are matched exactly; to add a command, write a handler
+// and register it here.
+//=============================================================================
+void CommandProcessor::registerHandlers()
+{
+   registerHandler("quit",        &CommandProcessor::handleQuit,        LANE_CONTROL);
+   registerHandler("status",      &CommandProcessor::handleStatus,      LANE_CONTROL);
+   registerHandler("start",       &CommandProcessor::handleStart,       LANE_CONTROL);
+   registerHandler("stop",        &CommandProcessor::handleStop,        LANE_CONTROL);
+   registerHandler("subscribe",   &CommandProcessor::handleSubscribe,   LANE_CONTROL);
+   registerHandler("unsubscribe", &CommandProcessor::handleUnsubscribe, LANE_CONTROL);
+   registerHandler("query",       &CommandProcessor::handleQuery,       LANE_DATA);
+}
+
+void CommandProcessor::registerHandler(const std::string& method, CommandHandler_t handler, Lane_t lane)
+{
+   HandlerEntry_t entry;
+   entry.handler = handler;
+   entry.lane = lane;
+   m_Handlers[method] = entry;
+}
+
+// unknown methods are data; a batch is control if any of its commands
+// is, so it runs in order on its connection's worker and is never stolen
+CommandProcessor::Lane_t CommandProcessor::laneOf(const PendingCommand_t& pending)
+{
+   if (pending.batch != NULL)
    {
-      m_latestResult->set_contact_radius(std::rand()*0.76);
-      m_latestResult->set_center_point(0, std::rand()*0.06);
-      m_latestResult->set_center_point(1, std::rand()*0.16);
+      for (int i = 0; i < pending.batch->commands_size(); i++)
+      {
+         if (laneOf(pending.batch->commands(i).method()) == LANE_CONTROL)
+            return LANE_CONTROL;
+      }
+      return LANE_DATA;
+   }
+
+   if (pending.cmd == NULL)
+      return LANE_DATA;
+
+   return laneOf(pending.cmd->method());
+}
+
+CommandProcessor::Lane_t CommandProcessor::laneOf(const std::string& method)
+{
+   std::unordered_map<std::string, HandlerEntry_t>::const_iterator it = m_Handlers.find(method);
+   return (it != m_Handlers.end()) ? it->second.lane : LANE_DATA;
+}
+
+bool CommandProcessor::handleQuit(RequestContext_t& request)
+{
+   if (m_exit_on_quit)
+   {
+      m_Log->LogDebug("Received quit cmd...shutting down...");
+      setRunning(false);
    }
-   pthread_mutex_unlock(&m_Working_Results);
 
-   usleep(10 * 1000);
+   request.response->mutable_result()->set_success(sandbox::Response_Success_TRUE);
    return true;
 }
 
-bool CommandProcessor::processCommands()
+bool CommandProcessor::handleStatus(RequestContext_t& request)
 {
-   std::shared_ptr<sandbox::Command> newCmd;
+   request.response->mutable_result()->set_status(sandbox::Response_Status_OK);
+   return true;
+}
 
-   if (!m_Running)
-      return false;
+bool CommandProcessor::handleStart(RequestContext_t& request)
+{
+   request.response->mutable_result()->set_success(sandbox::Response_Success_TRUE);
+   return true;
+}
+
+bool CommandProcessor::handleStop(RequestContext_t& request)
+{
+   request.response->mutable_result()->set_success(sandbox::Response_Success_TRUE);
+   return true;
+}
 
-   pthread_mutex_lock(&m_Working_CommandFIFO);
+bool CommandProcessor::handleQuery(RequestContext_t& request)
+{
+   sandbox::Response& response = *request.response;
+
+   ResultSnapshot_t result;
+   uint64_t version = m_latestResult.Load(result);
+
+   // wait for a newer result, unless the reply has to go out in a batch
+   if (request.cmd->has_after_version() && (version <= request.cmd->after_version()) && !request.batched)
    {
-      if (!m_CmdFIFO.empty())
+      bool parked = false;
+      pthread_mutex_lock(&m_Working_Parked);
+      {
+         if (m_ParkedQueries.size() < PARKED_QUERY_LIMIT)
+         {
+            ParkedQuery_t query;
+            query.connID = request.connID;
+            query.cmdID = request.cmd->id();
+            query.afterVersion = request.cmd->after_version();
+            m_ParkedQueries.push_back(query);
+            m_ParkedCount = m_ParkedQueries.size();
+            parked = true;
+         }
+      }
+      pthread_mutex_unlock(&m_Working_Parked);
+
+      if (parked)
       {
-         newCmd = m_CmdFIFO.front();
-         m_CmdFIFO.pop_front();
+         request.replied = true;
+         return true;
       }
+
+      m_Log->LogWarn("Too many queries waiting for a result, rejecting ", request.cmd->id());
+      response.mutable_result()->set_success(sandbox::Response_Success_FALSE);
+      return false;
+   }
+
+   if (version == 0)
+   {
+      // the program loop has not produced anything yet
+      response.mutable_result()->set_success(sandbox::Response_Success_FALSE);
+      return false;
    }
-   pthread_mutex_unlock(&m_Working_CommandFIFO);
 
-   if (newCmd->ByteSize() == 0)
+   if (!request.batched)
+   {
+      replyWithResult(request.connID, request.cmd->id(), result, version);
+      request.replied = true;
+      return true;
+   }
+
+   response.set_result_version(version);
+   response.mutable_result()->set_contact_radius(result.contact_radius);
+   response.mutable_result()->add_center_point(result.center_point[0]);
+   response.mutable_result()->add_center_point(result.center_point[1]);
+
+   return true;
+}
+
+//=============================================================================
+// replyWithResult
+//-----------------------------------------------------------------------------
+// Answers query cmdID with a published result: its id field followed by
+// the rest of the reply as serialized by programLoop.
+//=============================================================================
+void CommandProcessor::replyWithResult(int connID, int cmdID, const ResultSnapshot_t& result, uint64_t version)
+{
+   if (result.encodedSize > 0)
    {
-      m_response->set_id(newCmd->id());
-      m_response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+      uint8_t idField[16];
+      uint8_t* idEnd = WireFormatLite::WriteInt32ToArray(1, cmdID, idField);
+
+      struct iovec parts[2];
+      parts[0].iov_base = idField;
+      parts[0].iov_len = idEnd - idField;
+      parts[1].iov_base = (void*)result.encoded;
+      parts[1].iov_len = result.encodedSize;
+
+      m_Transport->TransmitFrameParts(connID, parts, 2);
+      return;
    }
 
-   // First see if newCmd is the 'quit' cmd
-   if (newCmd->method().find("quit") != std::string::npos)
+   sandbox::Response* reply = m_RespPool->Acquire();
+   reply->set_id(cmdID);
+   reply->set_result_version(version);
+   reply->mutable_result()->set_contact_radius(result.contact_radius);
+   reply->mutable_result()->add_center_point(result.center_point[0]);
+   reply->mutable_result()->add_center_point(result.center_point[1]);
+   m_Transport->TransmitFrame(connID, *reply);
+   m_RespPool->Release(reply);
+}
+
+//=============================================================================
+// completeParkedQueries
+//-----------------------------------------------------------------------------
+// Answers the parked queries the latest result is new enough for (command
+// worker).  Returns true if any were answered.  The replies go out after
+// m_Working_Parked is released: TransmitFrame can wait on a slow client,
+// and the RX thread takes the lock when a connection closes.
+//=============================================================================
+bool CommandProcessor::completeParkedQueries()
+{
+   if (m_ParkedCount == 0)
+      return false;
+
+   ResultSnapshot_t result;
+   uint64_t version = m_latestResult.Load(result);
+   bool answered = false;
+
+   ParkedQuery_t ready[PARKED_REPLY_BATCH];
+   size_t numReady;
+
+   do
    {
-      if (m_exit_on_quit)
+      numReady = 0;
+      pthread_mutex_lock(&m_Working_Parked);
       {
-         m_Log->LogDebug("Received quit cmd...shutting down...");
-         m_Running = false;
+         size_t kept = 0;
+         for (size_t i = 0; i < m_ParkedQueries.size(); i++)
+         {
+            const ParkedQuery_t& query = m_ParkedQueries[i];
+            if ((version > query.afterVersion) && (numReady < PARKED_REPLY_BATCH))
+               ready[numReady++] = query;
+            else
+               m_ParkedQueries[kept++] = query;
+         }
+         m_ParkedQueries.resize(kept);
+         m_ParkedCount = kept;
       }
+      pthread_mutex_unlock(&m_Working_Parked);
+
+      for (size_t i = 0; i < numReady; i++)
+         replyWithResult(ready[i].connID, ready[i].cmdID, result, version);
+      if (numReady > 0)
+         answered = true;
+   } while (numReady == PARKED_REPLY_BATCH);
+
+   return answered;
+}
+
+//=============================================================================
+// handleSubscribe
+//-----------------------------------------------------------------------------
+// From now on every every_n'th result is pushed to the connection as a
+// Response carrying the subscribe command's id, a sequence number and the
+// result version.  Subscribing again replaces the subscription.
+//=============================================================================
+bool CommandProcessor::handleSubscribe(RequestContext_t& request)
+{
+   Subscriber_t subscriber;
+   subscriber.cmdID = request.cmd->id();
+   subscriber.everyN = (request.cmd->every_n() > 0) ? request.cmd->every_n() : 1;
+   subscriber.sequence = 0;
+   subscriber.policy = m_PublishPolicy;
+   if (request.cmd->has_policy() && !parsePublishPolicy(request.cmd->policy(), subscriber.policy))
+   {
+      m_Log->LogWarn("Unknown publish policy '", request.cmd->policy(), "'");
+      request.response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+      return false;
+   }
+
+   pthread_mutex_lock(&m_Working_Subscribers);
+   {
+      m_Subscribers[request.connID] = subscriber;
    }
-   else if (newCmd->method().find("status") != std::string::npos)
+   pthread_mutex_unlock(&m_Working_Subscribers);
+
+   m_Log->LogDebug("Connection ", request.connID, " subscribed to every ", subscriber.everyN, " result(s)");
+
+   request.response->mutable_result()->set_success(sandbox::Response_Success_TRUE);
+   return true;
+}
+
+bool CommandProcessor::handleUnsubscribe(RequestContext_t& request)
+{
+   bool found;
+   pthread_mutex_lock(&m_Working_Subscribers);
    {
-      m_response->set_id(newCmd->id());
-      m_response->mutable_result()->set_status(sandbox::Response_Status_OK);
+      found = (m_Subscribers.erase(request.connID) > 0);
    }
+   pthread_mutex_unlock(&m_Working_Subscribers);
+
+   request.response->mutable_result()->set_success(found ? sandbox::Response_Success_TRUE : sandbox::Response_Success_FALSE);
+   return found;
+}
 
-   else if (newCmd->method().find("start") != std::string::npos)
+//=============================================================================
+// publishResult
+//-----------------------------------------------------------------------------
+// Pushes a freshly published result to the subscribers due for it
+// (program worker).  Only a PUBLISH_BLOCK subscriber can make this wait;
+// a slow one is otherwise conflated or disconnected by the transport.
+// The pushes are sent with m_Working_Subscribers released, so a waiting
+// push does not hold up (un)subscribe or connection events.
+//=============================================================================
+void CommandProcessor::publishResult(const ResultSnapshot_t& result, uint64_t version)
+{
+   // sequence numbers are taken under the lock, so they stay in order
+   // even if a push below fails or the subscription changes meanwhile
+   m_Pushes.clear();
+   pthread_mutex_lock(&m_Working_Subscribers);
    {
-      m_response->set_id(newCmd->id());
-      m_response->mutable_result()->set_success(sandbox::Response_Success_TRUE);
+      for (std::map<int, Subscriber_t>::iterator it = m_Subscribers.begin(); it != m_Subscribers.end(); ++it)
+      {
+         Subscriber_t& subscriber = it->second;
+         if ((version % subscriber.everyN) != 0)
+            continue;
+
+         Push_t push;
+         push.connID = it->first;
+         push.cmdID = subscriber.cmdID;
+         push.sequence = ++subscriber.sequence;
+         push.policy = subscriber.policy;
+         m_Pushes.push_back(push);
+      }
    }
+   pthread_mutex_unlock(&m_Working_Subscribers);
+
+   if (m_Pushes.empty())
+      return;
+
+   sandbox::Response* msg = m_RespPool->Acquire();
+   msg->set_result_version(version);
+   msg->mutable_result()->set_contact_radius(result.contact_radius);
+   msg->mutable_result()->add_center_point(result.center_point[0]);
+   msg->mutable_result()->add_center_point(result.center_point[1]);
 
-   else if (newCmd->method().find("stop") != std::string::npos)
+   size_t numFailed = 0;
+   for (size_t i = 0; i < m_Pushes.size(); i++)
    {
-      m_response->set_id(newCmd->id());
-      m_response->mutable_result()->set_success(sandbox::Response_Success_TRUE);
+      Push_t& push = m_Pushes[i];
+      msg->set_id(push.cmdID);
+      msg->set_sequence(push.sequence);
+
+      if (!m_Transport->PublishFrame(push.connID, *msg, push.policy))
+         m_Pushes[numFailed++] = push;
    }
+   m_RespPool->Release(msg);
+
+   if (numFailed == 0)
+      return;
 
-   else if (newCmd->method().find("query") != std::string::npos)
+   pthread_mutex_lock(&m_Working_Subscribers);
    {
-      m_response->set_id(newCmd->id());
+      for (size_t i = 0; i < numFailed; i++)
+      {
+         // unless the connection subscribed again in the meantime
+         std::map<int, Subscriber_t>::iterator it = m_Subscribers.find(m_Pushes[i].connID);
+         if ((it != m_Subscribers.end()) && (it->second.cmdID == m_Pushes[i].cmdID) &&
+             (it->second.sequence == m_Pushes[i].sequence))
+         {
+            LOG_DEBUG(m_Log, "Unable to push result to connection ", it->first, ", dropping its subscription");
+            m_Subscribers.erase(it);
+         }
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Subscribers);
+}
+
+bool CommandProcessor::parsePublishPolicy(const std::string& name, SocketTransport::PublishPolicy_t& policy)
+{
+   if (name == "conflate")
+      policy = SocketTransport::PUBLISH_CONFLATE;
+   else if (name == "block")
+      policy = SocketTransport::PUBLISH_BLOCK;
+   else if (name == "disconnect")
+      policy = SocketTransport::PUBLISH_DISCONNECT;
+   else
+      return false;
+
+   return true;
+}
 
-      pthread_mutex_lock(&m_Working_Results);
+//=============================================================================
+// connCBRoutine
+//-----------------------------------------------------------------------------
+// Connection events from the transport (RX thread).
+//=============================================================================
+bool CommandProcessor::connCBRoutine(intptr_t connID, void* connEvent)
+{
+   ISocket::ConnectionEvent_t event = *static_cast<ISocket::ConnectionEvent_t*>(connEvent);
+
+   if (event == ISocket::EVENT_DISCONNECTED)
+   {
+      pthread_mutex_lock(&m_Working_Subscribers);
       {
-         //m_response->mutable_result()->CopyFrom(m_latestResult);
-         m_response->mutable_result()->set_contact_radius(m_latestResult->contact_radius());
-         m_response->mutable_result()->set_center_point(0, m_latestResult->center_point(0));
-         m_response->mutable_result()->set_center_point(1, m_latestResult->center_point(1));
+         m_Subscribers.erase((int)connID);
       }
-      pthread_mutex_unlock(&m_Working_Results);
-
-
-//      double contact_radius;
-//      double center_point_x;
-//      double center_point_y;
-//
-//      pthread_mutex_lock(&m_Working_Results);
-//      {
-//         if (m_latestResult != NULL)
-//         {
-//            contact_radius = m_latestResult->contact_radius();
-//            center_point_x = m_latestResult->center_point(0);
-//            center_point_y = m_latestResult->center_point(1);
-//         }
-//         else
-//         {
-//            m_Log->LogDebug("No results yet, creating a fake set" );
-//
-//            contact_radius = -99.0;
-//            center_point_x = -99.0;
-//            center_point_y = -99.0;
-//         }
-//
-//         m_response->mutable_result()->CopyFrom(m_latestResult);
-//      }
-//      pthread_mutex_unlock(&m_Working_Results);
+      pthread_mutex_unlock(&m_Working_Subscribers);
 
+      pthread_mutex_lock(&m_Working_Parked);
+      {
+         size_t kept = 0;
+         for (size_t i = 0; i < m_ParkedQueries.size(); i++)
+         {
+            if (m_ParkedQueries[i].connID != (int)connID)
+               m_ParkedQueries[kept++] = m_ParkedQueries[i];
+         }
+         m_ParkedQueries.resize(kept);
+         m_ParkedCount = kept;
+      }
+      pthread_mutex_unlock(&m_Working_Parked);
    }
 
+   return true;
+}
+
+bool CommandProcessor::handleUnknown(RequestContext_t& request)
+{
+   LOG_DEBUG(m_Log, "Unknown command method '", request.cmd->method(), "' (id ", request.cmd->id(), ")");
+
+   request.response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+   return false;
+}
+
+bool CommandProcessor::processCommands(CommandWorker_t& worker)
+{
+   // back at work; whoever clears idle owns the count
+   if (worker.idle.exchange(false))
+      m_IdleWorkers--;
+
+   if (!m_Running)
+      return false;
+
+   bool answered = completeParkedQueries();
+
+   PendingCommand_t pending;
+   Lane_t lane;
+   uint64_t waitNs;
+   if (!popCommand(worker, pending, lane, waitNs))
+      return answered || !goIdle(worker);
+
+   worker.executed.fetch_add(1, std::memory_order_relaxed);
+   LOG_TRACE(m_Log, "worker %d: connection %d lane %d waited %llu ns", worker.index, pending.connID, (int)lane,
+             (unsigned long long)waitNs);
+
+   // fail fast rather than compute answers nobody is waiting for anymore
+   if ((lane == LANE_DATA) && (m_MaxQueueDelayNs > 0) && (waitNs > m_MaxQueueDelayNs))
+   {
+      m_Shed.fetch_add(1, std::memory_order_relaxed);
+      rejectCommand(pending, sandbox::Response_Status_OVERLOADED);
+      return true;
+   }
+
+   if (pending.batch != NULL)
+   {
+      executeBatch(pending, waitNs);
+      return true;
+   }
+
+   if (isExpired(*pending.cmd, waitNs))
+   {
+      m_Expired.fetch_add(1, std::memory_order_relaxed);
+      rejectCommand(pending, sandbox::Response_Status_EXPIRED);
+      return true;
+   }
+
+   RequestContext_t request;
+   request.connID = pending.connID;
+   request.cmd = pending.cmd;
+   request.response = m_RespPool->Acquire();
+   request.batched = false;
+   request.replied = false;
+
+   executeRequest(request);
+
+   return true;
+}
+
+//=============================================================================
+// popCommand
+//-----------------------------------------------------------------------------
+// Takes the worker's next command, control lane first.  After
+// CONTROL_BURST_LIMIT control commands in a row a waiting data command goes
+// next, so a flood of control traffic cannot starve the data lane.  With
+// both of its lanes empty the worker steals from the other workers' data
+// lanes.
+//=============================================================================
+bool CommandProcessor::popCommand(CommandWorker_t& worker, PendingCommand_t& pending, Lane_t& lane, uint64_t& waitNs)
+{
+   std::shared_ptr<MPMCQueue<PendingCommand_t> >* lanes = worker.lanes;
+
+   if ((worker.controlBurst < CONTROL_BURST_LIMIT) && lanes[LANE_CONTROL]->Pop(pending))
+   {
+      lane = LANE_CONTROL;
+      worker.controlBurst++;
+   }
+   else if (lanes[LANE_DATA]->Pop(pending))
+   {
+      lane = LANE_DATA;
+      worker.controlBurst = 0;
+   }
+   else if (lanes[LANE_CONTROL]->Pop(pending))
+   {
+      // nothing was waiting behind the burst
+      lane = LANE_CONTROL;
+      worker.controlBurst = 1;
+   }
    else
    {
-      m_response->set_id(newCmd->id());
-      m_response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+      // steal a data command, control commands stay with their worker
+      worker.controlBurst = 0;
+
+      bool stole = false;
+      for (size_t i = 1; (i < m_Workers.size()) && !stole; i++)
+      {
+         CommandWorker_t& victim = *m_Workers[(worker.index + i) % m_Workers.size()];
+         stole = victim.lanes[LANE_DATA]->Pop(pending);
+      }
+
+      if (!stole)
+         return false;
+
+      lane = LANE_DATA;
+      worker.stolen.fetch_add(1, std::memory_order_relaxed);
    }
 
-   std::string buf;
-   m_response->SerializeToString(&buf);
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   uint64_t nowNs = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+   waitNs = (nowNs > pending.queuedNs) ? (nowNs - pending.queuedNs) : 0;
 
-   m_Socket->sendData(buf.c_str(), (int)buf.length());
+   LaneWait_t& wait = m_LaneWait[lane];
+   wait.executed.fetch_add(1, std::memory_order_relaxed);
+   wait.totalNs.fetch_add(waitNs, std::memory_order_relaxed);
+   uint64_t maxNs = wait.maxNs.load(std::memory_order_relaxed);
+   while ((waitNs > maxNs) && !wait.maxNs.compare_exchange_weak(maxNs, waitNs, std::memory_order_relaxed))
+   {
+   }
 
    return true;
 }
 
 //=============================================================================
-// thread_func
+// goIdle
 //-----------------------------------------------------------------------------
+// Marks the worker idle before it sleeps, so producers can wake it to
+// steal.  Returns false if work showed up meanwhile (keep running).
 //=============================================================================
-void *CommandProcessor::thread_func(void *args)
+bool CommandProcessor::goIdle(CommandWorker_t& worker)
 {
-   ThreadHelper* threadHelper = static_cast<ThreadHelper*> (args);
+   worker.idle.store(true);
+   m_IdleWorkers++;
+
+   // pairs with the fence in recvCBRoutine: either the producer sees
+   // this worker idle, or this sees its command
+   std::atomic_thread_fence(std::memory_order_seq_cst);
 
-   while (!threadHelper->Done)
+   bool pending = (worker.lanes[LANE_CONTROL]->Depth() > 0);
+   for (size_t i = 0; (i < m_Workers.size()) && !pending; i++)
+      pending = (m_Workers[i]->lanes[LANE_DATA]->Depth() > 0);
+
+   if (pending && worker.idle.exchange(false))
    {
-      (threadHelper->obj->*(threadHelper->method))();
-      usleep(threadHelper->SleepTime_us);
+      m_IdleWorkers--;
+      return false;
    }
 
-   pthread_exit(0);
-   return NULL;
+   return true;
+}
+
+bool CommandProcessor::wakeIdleWorker()
+{
+   for (size_t i = 0; i < m_Workers.size(); i++)
+   {
+      CommandWorker_t& worker = *m_Workers[i];
+      if (worker.idle.load(std::memory_order_relaxed) && worker.idle.exchange(false))
+      {
+         m_IdleWorkers--;
+         worker.thread->Wake();
+         return true;
+      }
+   }
+   return false;
+}
+
+bool CommandProcessor::GetLaneStats(Lane_t lane, LaneStats_t& stats)
+{
+   if ((lane < 0) || (lane >= NUM_LANES) || m_Workers.empty())
+      return false;
+
+   stats.depth = 0;
+   stats.maxDepth = 0;
+   stats.rejected = 0;
+   for (size_t i = 0; i < m_Workers.size(); i++)
+   {
+      MPMCQueue<PendingCommand_t>::Stats_t queueStats = m_Workers[i]->lanes[lane]->GetStats();
+      stats.depth += queueStats.depth;
+      if (queueStats.maxDepth > stats.maxDepth)
+         stats.maxDepth = queueStats.maxDepth;
+      stats.rejected += queueStats.rejected;
+   }
+
+   const LaneWait_t& wait = m_LaneWait[lane];
+   stats.executed = wait.executed.load(std::memory_order_relaxed);
+   stats.avgWait_us = (stats.executed > 0) ? (wait.totalNs.load(std::memory_order_relaxed) / 1000.0 / stats.executed) : 0.0;
+   stats.maxWait_us = wait.maxNs.load(std::memory_order_relaxed) / 1000.0;
+
+   return true;
+}
+
+//=============================================================================
+// dispatchRequest
+//-----------------------------------------------------------------------------
+// Runs the handler of the request's command on its response.
+//=============================================================================
+void CommandProcessor::dispatchRequest(RequestContext_t& request)
+{
+   // every handler starts from an empty response carrying the command id
+   request.response->set_id(request.cmd->id());
+
+   CommandHandler_t handler = &CommandProcessor::handleUnknown;
+   std::unordered_map<std::string, HandlerEntry_t>::const_iterator it = m_Handlers.find(request.cmd->method());
+   if (it != m_Handlers.end())
+      handler = it->second.handler;
+
+   (this->*handler)(request);
+}
+
+//=============================================================================
+// executeRequest
+//-----------------------------------------------------------------------------
+// Runs the command's handler and queues its reply, then returns both
+// messages to their pools.
+//=============================================================================
+void CommandProcessor::executeRequest(RequestContext_t& request)
+{
+   dispatchRequest(request);
+
+   if (!request.replied)
+      m_Transport->TransmitFrame(request.connID, *request.response);
+
+   m_RespPool->Release(request.response);
+   m_CmdPool->Release(request.cmd);
+}
+
+//=============================================================================
+// executeBatch
+//-----------------------------------------------------------------------------
+// Runs every command of a batch in order and answers with one frame.  The
+// ResponseBatch keeps its cleared Responses in the pool, so steady state
+// batches do not allocate either.
+//=============================================================================
+void CommandProcessor::executeBatch(PendingCommand_t& pending, uint64_t waitNs)
+{
+   sandbox::ResponseBatch* replies = m_RespBatchPool->Acquire();
+
+   for (int i = 0; i < pending.batch->commands_size(); i++)
+   {
+      RequestContext_t request;
+      request.connID = pending.connID;
+      request.cmd = pending.batch->mutable_commands(i);
+      request.response = replies->add_responses();
+      request.batched = true;
+      request.replied = false;
+
+      if (isExpired(*request.cmd, waitNs))
+      {
+         m_Expired.fetch_add(1, std::memory_order_relaxed);
+         request.response->set_id(request.cmd->id());
+         request.response->mutable_result()->set_success(sandbox::Response_Success_FALSE);
+         request.response->mutable_result()->set_status(sandbox::Response_Status_EXPIRED);
+         continue;
+      }
+
+      dispatchRequest(request);
+   }
+
+   m_Transport->TransmitFrame(pending.connID, *replies);
+
+   m_RespBatchPool->Release(replies);
+   m_BatchPool->Release(pending.batch);
 }
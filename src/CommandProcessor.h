@@ -14,16 +14,56 @@
 #define  CommandProcessor_H
 
 #include <string>
-#include <deque>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
 
 #include "Callback.h"
 #include "Logger.h"
 #include "ISocket.h"
 #include "LinuxSocket.h"
+#include "IoUringSocket.h"
 #include "SocketTransport.h"
+#include "WorkerThread.h"
+#include "MPMCQueue.h"
+#include "SeqLock.h"
+#include "MessagePool.h"
 #include "CNT_JSON.h"
 #include "payload.pb.h"
 
+// Interval between simulated results
+#define PROGRAM_LOOP_PERIOD_S  0.01
+
+// Default data lane capacity per worker ("cmd_queue_size" in the config)
+#define CMD_QUEUE_SIZE  4096
+
+// Default number of command worker threads ("command_threads" in the config)
+#define COMMAND_THREADS  1
+#define MAX_COMMAND_THREADS  64
+
+// Control lane capacity ("control_queue_size" in the config)
+#define CONTROL_QUEUE_SIZE  256
+
+// Control commands run ahead of data commands, but after this many in a
+// row one waiting data command gets its turn
+#define CONTROL_BURST_LIMIT  8
+
+// Idle Response messages kept for reuse
+#define RESPONSE_POOL_SIZE  64
+
+// Most queries waiting for a newer result (after_version) at once
+#define PARKED_QUERY_LIMIT  1024
+
+// Parked queries answered per pass of completeParkedQueries
+#define PARKED_REPLY_BATCH  64
+
+// Idle CommandBatch/ResponseBatch messages kept for reuse
+#define BATCH_POOL_SIZE  64
+
+// Room for the serialized result field of a query reply
+#define RESULT_ENCODED_SIZE  64
+
 class CommandProcessor
 {
 public:
@@ -33,22 +73,53 @@ public:
     bool init(cJSON* config);
 
     bool Start();
-    bool doWork();
     bool Shutdown();
 
+    // Blocks until the processor stops running or timeout_s expires;
+    // returns IsRunning().  Commands run on the internal workers.
+    bool WaitForShutdown(double timeout_s);
+
     bool IsRunning();
 
-protected:
-    struct ThreadHelper
+    // command priority classes, each with its own FIFO
+    enum Lane_t
+    {
+        LANE_CONTROL = 0,   // quit, stop, start, status, (un)subscribe
+        LANE_DATA,          // query, and batches of data commands only
+        NUM_LANES
+    };
+
+    struct LaneStats_t
     {
-        pthread_t		thread_handle;
-        pthread_attr_t	thread_attrib;
+        size_t   depth;
+        size_t   maxDepth;
+        uint64_t executed;
+        uint64_t rejected;
+        double   avgWait_us;    // queued until the command worker took it
+        double   maxWait_us;
+    };
 
-        CommandProcessor	*obj;
+    bool GetLaneStats(Lane_t lane, LaneStats_t& stats);
 
-        bool 	(CommandProcessor::*method)(void);
-        bool	Done;
-        int     SleepTime_us;
+protected:
+    // a received command and the connection its reply goes back to
+    struct PendingCommand_t
+    {
+        int connID;
+        sandbox::Command* cmd;          // from m_CmdPool, or
+        sandbox::CommandBatch* batch;   // from m_BatchPool
+        uint64_t queuedNs;              // CLOCK_MONOTONIC, for the lane wait time
+    };
+
+    // everything handling one command touches; nothing in here is shared
+    // with other requests, so requests can be executed concurrently
+    struct RequestContext_t
+    {
+        int                connID;
+        sandbox::Command*  cmd;         // from m_CmdPool or part of a batch
+        sandbox::Response* response;    // from m_RespPool or part of a batch
+        bool               batched;     // the reply goes out in a ResponseBatch
+        bool               replied;     // the handler transmitted (or parked) the reply
     };
 
     bool m_Debug;
@@ -60,31 +131,161 @@ protected:
 
     std::string m_buildStats;
 
-    pthread_mutex_t m_Working_CommandFIFO;
     pthread_mutex_t m_Working_Program;
-    pthread_mutex_t m_Working_Results;
+    pthread_mutex_t m_Working_State;
+    pthread_cond_t  m_StateChanged;
 
     std::shared_ptr<ISocket> m_Socket;
     std::shared_ptr<SocketTransport> m_Transport;
 
-    std::shared_ptr<sandbox::Response_Result> m_latestResult;
-    std::shared_ptr<sandbox::Response> m_response;
+    // latest program result, published by programLoop without blocking
+    // and read lock-free by query
+    struct ResultSnapshot_t
+    {
+        double contact_radius;
+        double center_point[2];
+        // the Response.result field (tag, length, Result) serialized once
+        // per result, so query replies only add their id (0: too large)
+        uint32_t encodedSize;
+        char     encoded[RESULT_ENCODED_SIZE];
+    };
+    SeqLock<ResultSnapshot_t> m_latestResult;
+    // program worker only, serializes the result into its snapshot
+    sandbox::Response m_ResultEncoder;
+    // recycled replies, one per command in flight
+    std::shared_ptr<MessagePool<sandbox::Response> > m_RespPool;
+
+    // RX thread: one whole frame, data is only valid during the call
+    bool recvCBRoutine(int replyID, const char* data, int numBytes);
 
-    Callback2<CommandProcessor, bool, intptr_t, void* >* m_callback;
-    ICallback* m_ICallbackPtr;
-    //bool CommandProcessor::recvCBRoutine(int replyID, void* strCBMsg);
-    bool recvCBRoutine(intptr_t replyID, void* strCBMsg);
+    Callback2<CommandProcessor, bool, intptr_t, void* >* m_connCallback;
+    bool connCBRoutine(intptr_t connID, void* connEvent);
 
-    ThreadHelper m_ThreadHelper;
+    // result subscriptions, keyed by connection ID
+    struct Subscriber_t
+    {
+        int      cmdID;         // id of the subscribe command, echoed in pushes
+        int      everyN;
+        uint32_t sequence;      // last sequence number pushed
+        SocketTransport::PublishPolicy_t policy;
+    };
+    std::map<int, Subscriber_t> m_Subscribers;
+    pthread_mutex_t m_Working_Subscribers;
 
-    bool processCommands();
+    SocketTransport::PublishPolicy_t m_PublishPolicy;     // default for new subscriptions
+
+    // one push of a result, built under m_Working_Subscribers and sent
+    // after it is released (program worker only)
+    struct Push_t
+    {
+        int      connID;
+        int      cmdID;
+        uint32_t sequence;
+        SocketTransport::PublishPolicy_t policy;
+    };
+    std::vector<Push_t> m_Pushes;
+
+    void publishResult(const ResultSnapshot_t& result, uint64_t version);
+
+    // queries waiting for a result newer than afterVersion; answered by
+    // the command worker, out of order with the connection's other commands
+    struct ParkedQuery_t
+    {
+        int      connID;
+        int      cmdID;
+        uint64_t afterVersion;
+    };
+    std::vector<ParkedQuery_t> m_ParkedQueries;
+    std::atomic<unsigned>      m_ParkedCount;
+    pthread_mutex_t            m_Working_Parked;
+
+    bool completeParkedQueries();
+    void replyWithResult(int connID, int cmdID, const ResultSnapshot_t& result, uint64_t version);
+    bool parsePublishPolicy(const std::string& name, SocketTransport::PublishPolicy_t& policy);
+
+    // programLoop runs every PROGRAM_LOOP_PERIOD_S, processCommands on
+    // the command workers whenever recvCBRoutine queues a command
+    WorkerThread m_ProgramWorker;
+    Callback0<CommandProcessor, bool>* m_ProgramStep;
+
+    // One of the command worker threads, with its own lanes.  A
+    // connection's commands always go to the same worker, so its control
+    // commands run in order; an idle worker steals data commands from the
+    // others, which gives up reply order for them (see command_threads).
+    struct CommandWorker_t
+    {
+        CommandWorker_t(CommandProcessor* processor, int workerIndex, size_t controlSize, size_t dataSize);
+        ~CommandWorker_t();
+
+        CommandProcessor* owner;
+        int               index;
+        WorkerThread*     thread;
+        Callback0<CommandWorker_t, bool>* step;
+        std::shared_ptr<MPMCQueue<PendingCommand_t> > lanes[NUM_LANES];
+        unsigned          controlBurst;     // control commands run in a row
+        std::atomic<bool> idle;             // about to sleep, a producer may wake it to steal
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> stolen;
+
+        bool run() { return owner->processCommands(*this); }
+    };
+    std::vector<std::shared_ptr<CommandWorker_t> > m_Workers;
+    std::atomic<int> m_IdleWorkers;
+
+    void setRunning(bool running);
+    bool processCommands(CommandWorker_t& worker);
+    bool goIdle(CommandWorker_t& worker);
+    bool wakeIdleWorker();
+    void dispatchRequest(RequestContext_t& request);
+    void executeRequest(RequestContext_t& request);
+    void executeBatch(PendingCommand_t& pending, uint64_t waitNs);
+    void rejectCommand(PendingCommand_t& pending, sandbox::Response_Status status, bool mayWait = true);
+
+    // command handlers, looked up by exact method name; each fills in the
+    // result of a response that already carries the command id
+    typedef bool (CommandProcessor::*CommandHandler_t)(RequestContext_t&);
+    struct HandlerEntry_t
+    {
+        CommandHandler_t handler;
+        Lane_t           lane;
+    };
+    std::unordered_map<std::string, HandlerEntry_t> m_Handlers;
+
+    void registerHandler(const std::string& method, CommandHandler_t handler, Lane_t lane);
+    Lane_t laneOf(const PendingCommand_t& pending);
+    Lane_t laneOf(const std::string& method);
+
+    void registerHandlers();
+    bool handleQuit(RequestContext_t& request);
+    bool handleStatus(RequestContext_t& request);
+    bool handleStart(RequestContext_t& request);
+    bool handleStop(RequestContext_t& request);
+    bool handleQuery(RequestContext_t& request);
+    bool handleSubscribe(RequestContext_t& request);
+    bool handleUnsubscribe(RequestContext_t& request);
+    bool handleUnknown(RequestContext_t& request);
     bool programLoop();
-    std::deque<std::shared_ptr<sandbox::Command> > m_CmdFIFO;
-    sandbox::Command decodeToCmd(char* buffer);
-    std::string encodeResponse(sandbox::Response );
-
-    // STATIC 
-    static void *thread_func(void *args);
+    // lane wait times, written by the command workers
+    struct LaneWait_t
+    {
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> totalNs;
+        std::atomic<uint64_t> maxNs;
+    };
+    LaneWait_t m_LaneWait[NUM_LANES];
+
+    bool popCommand(CommandWorker_t& worker, PendingCommand_t& pending, Lane_t& lane, uint64_t& waitNs);
 
+    // data commands that waited longer than this are shed (0: never)
+    uint64_t m_MaxQueueDelayNs;
+    std::atomic<uint64_t> m_Shed;
+    std::atomic<uint64_t> m_Expired;
+    // recycled Command messages, so steady state parsing does not allocate
+    std::shared_ptr<MessagePool<sandbox::Command> > m_CmdPool;
+    std::shared_ptr<MessagePool<sandbox::CommandBatch> > m_BatchPool;
+    std::shared_ptr<MessagePool<sandbox::ResponseBatch> > m_RespBatchPool;
+    bool isCommandBatch(const char* buffer, int size);
+    bool decodeBuffer(const char* buffer, int size, google::protobuf::MessageLite& msg);
+
 };
 #endif
@@ -0,0 +1,90 @@
+#ifndef __DELEGATE_H__
+#define __DELEGATE_H__
+//=============================================================================
+//   Typed, non-owning callbacks for hot paths.  Unlike ICallback there is
+// no virtual call, no void* casting of arguments and no stored return
+// value: a Delegate is an object pointer plus a pointer to a small stub
+// that the compiler generates (and inlines the target into) per bound
+// function.
+//
+// //Format is Delegate<Return type(argument types)>.
+// Delegate<bool(int, const char*, int)> d;
+//
+//   d = Delegate<bool(int, const char*, int)>::Bind<EchoServer, &EchoServer::OnFrame>(&server);
+//
+//   d(connID, data, numBytes);
+//
+//   Like ICallback pointers, a Delegate does not own its object (nor a
+// callable bound with FromCallable); it must outlive every call.
+//=============================================================================
+
+template<typename SIGNATURE> class Delegate;
+
+template<typename RETURN_TYPE, typename... ARGUMENT_TYPES>
+class Delegate<RETURN_TYPE(ARGUMENT_TYPES...)>
+{
+ public:
+   Delegate() : m_Object(0), m_Stub(0)
+   {
+   }
+
+   // member function, chosen at compile time
+   template<class CLASS_TYPE, RETURN_TYPE (CLASS_TYPE::*METHOD)(ARGUMENT_TYPES...)>
+   static Delegate Bind(CLASS_TYPE *c)
+   {
+      return Delegate(c, &methodStub<CLASS_TYPE, METHOD>);
+   }
+
+   // free or static function, chosen at compile time
+   template<RETURN_TYPE (*FUNCTION)(ARGUMENT_TYPES...)>
+   static Delegate Bind()
+   {
+      return Delegate(0, &functionStub<FUNCTION>);
+   }
+
+   // any callable object (lambda, functor), referenced not copied
+   template<typename CALLABLE>
+   static Delegate FromCallable(CALLABLE *f)
+   {
+      return Delegate(f, &callableStub<CALLABLE>);
+   }
+
+   RETURN_TYPE operator()(ARGUMENT_TYPES... args) const
+   {
+      return m_Stub(m_Object, args...);
+   }
+
+   explicit operator bool() const
+   {
+      return m_Stub != 0;
+   }
+
+ private:
+   typedef RETURN_TYPE (*STUB_TYPE)(void *, ARGUMENT_TYPES...);
+
+   Delegate(void *object, STUB_TYPE stub) : m_Object(object), m_Stub(stub)
+   {
+   }
+
+   template<class CLASS_TYPE, RETURN_TYPE (CLASS_TYPE::*METHOD)(ARGUMENT_TYPES...)>
+   static RETURN_TYPE methodStub(void *object, ARGUMENT_TYPES... args)
+   {
+      return (static_cast<CLASS_TYPE *>(object)->*METHOD)(args...);
+   }
+
+   template<RETURN_TYPE (*FUNCTION)(ARGUMENT_TYPES...)>
+   static RETURN_TYPE functionStub(void *, ARGUMENT_TYPES... args)
+   {
+      return FUNCTION(args...);
+   }
+
+   template<typename CALLABLE>
+   static RETURN_TYPE callableStub(void *object, ARGUMENT_TYPES... args)
+   {
+      return (*static_cast<CALLABLE *>(object))(args...);
+   }
+
+   void *m_Object;
+   STUB_TYPE m_Stub;
+};
+#endif
@@ -14,6 +14,12 @@
 #ifndef  ISocket_H
 #define  ISocket_H
 
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "Callback.h"
 
 class  ISocket
 {
@@ -34,6 +40,28 @@ public:
         STATE_CONNECTED
     };
 
+    /* Per-connection events handed to the receive callback by PollEvents() */
+    enum ConnectionEvent_t
+    {
+        EVENT_CONNECTED = 0,
+        EVENT_DATA,
+        EVENT_DISCONNECTED
+    };
+
+    /*
+     * Passed as the second argument of the receive callback, the first one
+     * being the connection ID.  data is only valid for the duration of the
+     * callback.
+     */
+    struct RecvEvent_t
+    {
+        ConnectionEvent_t event;
+        int               connID;
+        const char*       data;
+        int               numBytes;
+        std::string       peer;
+    };
+
     virtual bool init(ConnectionMode_t mode, const std::string IPAddress, const int port) = 0; 
 
     virtual bool readLine(char* rcvBuffer, int buffer_length, int& numRead, double timeout_s = 1.0, bool stopOnDisconnect = false) = 0;
@@ -43,7 +71,22 @@ public:
 
     virtual bool sendData(const char* data, int numBytes) = 0;
 
-    virtual bool ListenForClient(std::string& client_IP) = 0;
+    // Server mode: wait up to timeout_s for readiness on the listening socket
+    // and every accepted connection, and dispatch RecvEvent_t's to the
+    // registered receive callback.
+    virtual bool PollEvents(double timeout_s = 1.0) = 0;
+    virtual bool sendData(int connID, const char* data, int numBytes) = 0;
+    virtual bool CloseConnection(int connID) = 0;
+
+    // Non-blocking gather write.  Returns the number of bytes taken (0 if
+    // the connection would block), or -1 if the connection is gone.
+    virtual int writeData(int connID, const struct iovec* iov, int iovcnt) = 0;
+
+    // Blocks until one of connIDs is writable, wakeFd is readable, or
+    // timeout_s expires.  On return connIDs holds the writable ones.
+    virtual bool WaitWritable(std::vector<int>& connIDs, int wakeFd, double timeout_s) = 0;
+
+    virtual bool RegisterRecvCallback(int callbackID, ICallback* callbackPtr) = 0;
 
     virtual bool ListenForTraffic() = 0;
 
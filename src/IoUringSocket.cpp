@@ -0,0 +1,1154 @@
+/**************************************************************************
+ *
+ *          Source:   IoUringSocket.cpp
+ *           Project:  ScorpionServer
+ *
+ *            Author: trafferty
+ *              Date: Oct 17, 2026
+ *
+ *     Description:
+ *       > io_uring implementation of an ISocket
+ *
+ ****************************************************************************/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/time_types.h>
+
+#include "IoUringSocket.h"
+
+#define INVALID_SOCKET -1
+
+static inline uint64_t makeUserData(int op, int id)
+{
+   return ((uint64_t)op << 56) | (uint32_t)id;
+}
+
+static inline int io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+   return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argsz)
+{
+   return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argsz);
+}
+
+static inline int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+   return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+IoUringSocket::IoUringSocket(const char* name, const bool debug) :
+m_Debug(debug),
+m_Name(name),
+m_Log(nullptr),
+m_IPAddress(""),
+m_Port(0),
+m_ConnectionMode(ISocket::CONN_MODE_SERVER),
+m_ConnectionState(ISocket::STATE_NO_CONNECTION),
+m_ServerSock(INVALID_SOCKET),
+m_RingFd(INVALID_SOCKET),
+m_SqRingPtr(MAP_FAILED),
+m_SqRingSize(0),
+m_SqHead(nullptr),
+m_SqTail(nullptr),
+m_SqMask(0),
+m_SqEntries(0),
+m_SqPending(0),
+m_Sqes(nullptr),
+m_SqesSize(0),
+m_CqRingPtr(MAP_FAILED),
+m_CqRingSize(0),
+m_CqHead(nullptr),
+m_CqTail(nullptr),
+m_CqMask(0),
+m_Cqes(nullptr),
+m_BufRing(nullptr),
+m_BufRingSize(0),
+m_BufBase(nullptr),
+m_NextConnID(1),
+m_WritableFd(INVALID_SOCKET),
+m_InPoll(false),
+m_RecvCallbackPtr(nullptr)
+{
+   m_Log = std::shared_ptr<Logger>(new Logger(m_Name, m_Debug));
+
+   pthread_mutex_init(&m_Working_Connections, NULL);
+   pthread_mutex_init(&m_Working_Ring, NULL);
+
+   m_WritableFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+IoUringSocket::~IoUringSocket()
+{
+   CloseConnection();
+
+   if (m_WritableFd != INVALID_SOCKET)
+      close(m_WritableFd);
+
+   pthread_mutex_destroy(&m_Working_Connections);
+   pthread_mutex_destroy(&m_Working_Ring);
+}
+
+bool IoUringSocket::init(ConnectionMode_t mode, const std::string IPAddress, const int port)
+{
+   m_ConnectionMode = mode;
+   m_IPAddress = IPAddress;
+   m_Port = port;
+
+   if (m_ConnectionMode != CONN_MODE_SERVER)
+   {
+      m_Log->LogError("[",m_Name,"] io_uring socket only supports CONN_MODE_SERVER");
+      return false;
+   }
+
+   if (!setupRing() || !setupListener())
+   {
+      m_ConnectionState = ISocket::ConnectionState_t::STATE_NO_CONNECTION;
+      return false;
+   }
+
+   return true;
+}
+
+bool IoUringSocket::setupRing()
+{
+   struct io_uring_params params;
+   memset(&params, 0, sizeof(params));
+   params.flags = IORING_SETUP_CQSIZE;
+   params.cq_entries = URING_CQ_ENTRIES;
+
+   m_RingFd = io_uring_setup(URING_ENTRIES, &params);
+   if (m_RingFd < 0)
+   {
+      m_Log->LogError("[",m_Name,"] io_uring_setup failed: ", strerror(errno));
+      m_RingFd = INVALID_SOCKET;
+      return false;
+   }
+
+   if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_FAST_POLL))
+   {
+      m_Log->LogError("[",m_Name,"] Kernel io_uring is too old (need EXT_ARG and FAST_POLL)");
+      teardownRing();
+      return false;
+   }
+
+   m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   m_SqesSize   = params.sq_entries * sizeof(struct io_uring_sqe);
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      if (m_CqRingSize > m_SqRingSize)
+         m_SqRingSize = m_CqRingSize;
+      m_CqRingSize = m_SqRingSize;
+   }
+
+   m_SqRingPtr = mmap(0, m_SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQ_RING);
+   if (m_SqRingPtr == MAP_FAILED)
+   {
+      m_Log->LogError("[",m_Name,"] Unable to map submission ring: ", strerror(errno));
+      teardownRing();
+      return false;
+   }
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      m_CqRingPtr = m_SqRingPtr;
+   }
+   else
+   {
+      m_CqRingPtr = mmap(0, m_CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_CQ_RING);
+      if (m_CqRingPtr == MAP_FAILED)
+      {
+         m_Log->LogError("[",m_Name,"] Unable to map completion ring: ", strerror(errno));
+         teardownRing();
+         return false;
+      }
+   }
+
+   void* sqes = mmap(0, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQES);
+   if (sqes == MAP_FAILED)
+   {
+      m_Log->LogError("[",m_Name,"] Unable to map submission entries: ", strerror(errno));
+      teardownRing();
+      return false;
+   }
+   m_Sqes = (io_uring_sqe*)sqes;
+
+   char* sq = (char*)m_SqRingPtr;
+   m_SqHead    = (unsigned*)(sq + params.sq_off.head);
+   m_SqTail    = (unsigned*)(sq + params.sq_off.tail);
+   m_SqMask    = *(unsigned*)(sq + params.sq_off.ring_mask);
+   m_SqEntries = *(unsigned*)(sq + params.sq_off.ring_entries);
+
+   // entry i of the submission array always points at sqe i
+   unsigned* sqArray = (unsigned*)(sq + params.sq_off.array);
+   for (unsigned i = 0; i < m_SqEntries; i++)
+      sqArray[i] = i;
+
+   char* cq = (char*)m_CqRingPtr;
+   m_CqHead = (unsigned*)(cq + params.cq_off.head);
+   m_CqTail = (unsigned*)(cq + params.cq_off.tail);
+   m_CqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+   m_Cqes   = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+   // provided buffer ring: the ring itself plus the buffers, one mapping
+   m_BufRingSize = URING_BUFFER_COUNT * sizeof(struct io_uring_buf) + URING_BUFFER_COUNT * URING_BUFFER_SIZE;
+   void* bufMem = mmap(0, m_BufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+   if (bufMem == MAP_FAILED)
+   {
+      m_Log->LogError("[",m_Name,"] Unable to allocate receive buffers: ", strerror(errno));
+      teardownRing();
+      return false;
+   }
+   m_BufRing = (io_uring_buf_ring*)bufMem;
+   m_BufBase = (char*)bufMem + URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+
+   struct io_uring_buf_reg reg;
+   memset(&reg, 0, sizeof(reg));
+   reg.ring_addr    = (uint64_t)(uintptr_t)m_BufRing;
+   reg.ring_entries = URING_BUFFER_COUNT;
+   reg.bgid         = URING_BUFFER_GROUP;
+   if (io_uring_register(m_RingFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+   {
+      m_Log->LogError("[",m_Name,"] Unable to register receive buffers: ", strerror(errno));
+      teardownRing();
+      return false;
+   }
+
+   m_BufRing->tail = 0;
+   for (unsigned short i = 0; i < URING_BUFFER_COUNT; i++)
+      recycleBuffer(i);
+
+   m_Log->LogDebug("[",m_Name,"] io_uring set up: ", m_SqEntries, " sq entries, ", URING_BUFFER_COUNT, " receive buffers");
+   return true;
+}
+
+void IoUringSocket::teardownRing()
+{
+   if (m_BufRing != nullptr)
+   {
+      munmap(m_BufRing, m_BufRingSize);
+      m_BufRing = nullptr;
+      m_BufBase = nullptr;
+   }
+
+   if (m_Sqes != nullptr)
+   {
+      munmap(m_Sqes, m_SqesSize);
+      m_Sqes = nullptr;
+   }
+
+   if ((m_CqRingPtr != MAP_FAILED) && (m_CqRingPtr != m_SqRingPtr))
+      munmap(m_CqRingPtr, m_CqRingSize);
+   m_CqRingPtr = MAP_FAILED;
+
+   if (m_SqRingPtr != MAP_FAILED)
+      munmap(m_SqRingPtr, m_SqRingSize);
+   m_SqRingPtr = MAP_FAILED;
+
+   if (m_RingFd != INVALID_SOCKET)
+   {
+      close(m_RingFd);
+      m_RingFd = INVALID_SOCKET;
+   }
+
+   m_SqPending = 0;
+}
+
+bool IoUringSocket::setupListener()
+{
+   m_ServerSock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (m_ServerSock == INVALID_SOCKET)
+   {
+      m_Log->LogError("[",m_Name,"] Error creating listening socket");
+      return false;
+   }
+
+   int yes = 1;
+   setsockopt(m_ServerSock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+   struct sockaddr_in server_addr;
+   memset(&server_addr, '\0', sizeof(server_addr));
+   server_addr.sin_family = AF_INET;
+   server_addr.sin_port = htons(m_Port);
+   server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+   m_Log->LogInfo("[",m_Name,"] Setting up io_uring server socket on port: ", m_Port );
+
+   if (bind(m_ServerSock, (struct sockaddr*) &server_addr, sizeof(server_addr)) == -1)
+   {
+      m_Log->LogError("[",m_Name,"] Unable to bind socket: ", strerror(errno));
+      close(m_ServerSock);
+      m_ServerSock = INVALID_SOCKET;
+      return false;
+   }
+
+   if (listen(m_ServerSock, SOMAXCONN) == -1)
+   {
+      m_Log->LogError("[",m_Name,"] Listen failed...");
+      close(m_ServerSock);
+      m_ServerSock = INVALID_SOCKET;
+      return false;
+   }
+
+   pthread_mutex_lock(&m_Working_Ring);
+   {
+      armAccept();
+      submitPending();
+   }
+   pthread_mutex_unlock(&m_Working_Ring);
+
+   m_Log->LogDebug("Listening for clients...");
+   m_ConnectionState = ISocket::ConnectionState_t::STATE_SERVER_LISTENING;
+
+   return true;
+}
+
+//=============================================================================
+// submission side; every function here expects m_Working_Ring to be held
+//=============================================================================
+io_uring_sqe* IoUringSocket::getSqe()
+{
+   unsigned head = __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE);
+   unsigned tail = *m_SqTail;
+
+   if (tail - head >= m_SqEntries)
+   {
+      // ring full: hand what we have to the kernel and try again
+      submitPending();
+      head = __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE);
+      if (tail - head >= m_SqEntries)
+         return nullptr;
+   }
+
+   io_uring_sqe* sqe = &m_Sqes[tail & m_SqMask];
+   memset(sqe, 0, sizeof(*sqe));
+   return sqe;
+}
+
+static inline void commitSqe(unsigned* sqTail, unsigned& sqPending)
+{
+   __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+   sqPending++;
+}
+
+bool IoUringSocket::submitPending()
+{
+   while (m_SqPending > 0)
+   {
+      int ret = io_uring_enter(m_RingFd, m_SqPending, 0, 0, NULL, 0);
+      if (ret < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         if ((errno == EAGAIN) || (errno == EBUSY))
+            return true;  // the next PollEvents will retry
+
+         m_Log->LogError("[",m_Name,"] io_uring_enter (submit) failed: ", strerror(errno));
+         return false;
+      }
+      m_SqPending -= (unsigned)ret;
+   }
+   return true;
+}
+
+void IoUringSocket::armAccept()
+{
+   io_uring_sqe* sqe = getSqe();
+   if (sqe == nullptr)
+   {
+      m_Log->LogError("[",m_Name,"] Submission queue full, unable to arm accept");
+      return;
+   }
+
+   sqe->opcode       = IORING_OP_ACCEPT;
+   sqe->fd           = m_ServerSock;
+   sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+   sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+   sqe->user_data    = makeUserData(OP_ACCEPT, 0);
+   commitSqe(m_SqTail, m_SqPending);
+}
+
+void IoUringSocket::armRecv(int connID, int sock)
+{
+   io_uring_sqe* sqe = getSqe();
+   if (sqe == nullptr)
+   {
+      m_Log->LogError("[",m_Name,"] Submission queue full, unable to arm recv on connection ", connID);
+      return;
+   }
+
+   sqe->opcode    = IORING_OP_RECV;
+   sqe->fd        = sock;
+   sqe->ioprio    = IORING_RECV_MULTISHOT;
+   sqe->flags     = IOSQE_BUFFER_SELECT;
+   sqe->buf_group = URING_BUFFER_GROUP;
+   sqe->user_data = makeUserData(OP_RECV, connID);
+   commitSqe(m_SqTail, m_SqPending);
+}
+
+// expects m_Working_Connections to be held as well
+void IoUringSocket::armSend(int connID, Connection_t& conn)
+{
+   io_uring_sqe* sqe = getSqe();
+   if (sqe == nullptr)
+   {
+      m_Log->LogError("[",m_Name,"] Submission queue full, dropping send on connection ", connID);
+      conn.inflight.clear();
+      conn.sending = false;
+      return;
+   }
+
+   sqe->opcode    = IORING_OP_SEND;
+   sqe->fd        = conn.sock;
+   sqe->addr      = (uint64_t)(uintptr_t)conn.inflight.data();
+   sqe->len       = conn.inflight.size();
+   sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+   sqe->user_data = makeUserData(OP_SEND, connID);
+   commitSqe(m_SqTail, m_SqPending);
+   conn.sending = true;
+}
+
+// only called from the completion side (PollEvents thread)
+void IoUringSocket::recycleBuffer(unsigned short bufID)
+{
+   // not m_BufRing->bufs: as C++ the header's flexible array member lands
+   // at offset 8 instead of 0, so index the entries by hand
+   unsigned short tail = m_BufRing->tail;
+   struct io_uring_buf* buf = (struct io_uring_buf*)m_BufRing + (tail & (URING_BUFFER_COUNT - 1));
+
+   buf->addr = (uint64_t)(uintptr_t)(m_BufBase + (size_t)bufID * URING_BUFFER_SIZE);
+   buf->len  = URING_BUFFER_SIZE;
+   buf->bid  = bufID;
+
+   __atomic_store_n(&m_BufRing->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+//=============================================================================
+// completion side
+//=============================================================================
+bool IoUringSocket::PollEvents(double timeout_s)
+{
+   if (m_RingFd == INVALID_SOCKET)
+   {
+      m_Log->LogError("[",m_Name,"] PollEvents failed: ring not set up");
+      return false;
+   }
+
+   unsigned toSubmit;
+   pthread_mutex_lock(&m_Working_Ring);
+   {
+      m_PollThread = pthread_self();
+      m_InPoll = true;
+      toSubmit = m_SqPending;
+      m_SqPending = 0;
+   }
+   pthread_mutex_unlock(&m_Working_Ring);
+
+   // only block if there is nothing to reap already
+   unsigned head = *m_CqHead;
+   if (head == __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE))
+   {
+      struct __kernel_timespec ts;
+      ts.tv_sec  = (long long)timeout_s;
+      ts.tv_nsec = (long long)((timeout_s - (double)ts.tv_sec) * 1e9);
+
+      struct io_uring_getevents_arg arg;
+      memset(&arg, 0, sizeof(arg));
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+
+      int ret = io_uring_enter(m_RingFd, toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+      if ((ret < 0) && (errno != ETIME) && (errno != EINTR))
+      {
+         m_Log->LogError("[",m_Name,"] io_uring_enter failed: ", strerror(errno));
+         return false;
+      }
+   }
+   else if (toSubmit > 0)
+   {
+      pthread_mutex_lock(&m_Working_Ring);
+      {
+         m_SqPending += toSubmit;
+         submitPending();
+      }
+      pthread_mutex_unlock(&m_Working_Ring);
+   }
+
+   unsigned tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+   while (head != tail)
+   {
+      io_uring_cqe cqe = m_Cqes[head & m_CqMask];
+      head++;
+      __atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+
+      handleCompletion(cqe);
+
+      if (head == tail)
+         tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+   }
+
+   // whatever the handlers queued (re-armed recvs, follow-up sends)
+   pthread_mutex_lock(&m_Working_Ring);
+   {
+      m_InPoll = false;
+      submitPending();
+   }
+   pthread_mutex_unlock(&m_Working_Ring);
+
+   return true;
+}
+
+void IoUringSocket::handleCompletion(const io_uring_cqe& cqe)
+{
+   int op = (int)(cqe.user_data >> 56);
+   int id = (int)(uint32_t)cqe.user_data;
+
+   switch (op)
+   {
+      case OP_ACCEPT:
+         handleAccept(cqe);
+         break;
+
+      case OP_RECV:
+         handleRecv(id, cqe);
+         break;
+
+      case OP_SEND:
+         handleSend(id, cqe);
+         break;
+
+      case OP_CANCEL:
+      default:
+         break;
+   }
+}
+
+void IoUringSocket::handleAccept(const io_uring_cqe& cqe)
+{
+   if (!(cqe.flags & IORING_CQE_F_MORE) && (m_ServerSock != INVALID_SOCKET))
+   {
+      // the multishot accept terminated, put a new one in place
+      pthread_mutex_lock(&m_Working_Ring);
+      {
+         armAccept();
+      }
+      pthread_mutex_unlock(&m_Working_Ring);
+   }
+
+   if (cqe.res < 0)
+   {
+      if (cqe.res != -ECANCELED)
+         m_Log->LogError("[",m_Name,"] accept failed: ", strerror(-cqe.res));
+      return;
+   }
+
+   int sock = cqe.res;
+
+   size_t numConnections;
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      numConnections = m_Connections.size();
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   if (numConnections >= URING_MAXCONNECTIONS)
+   {
+      m_Log->LogWarn("[",m_Name,"] Too many connections, rejecting client");
+      close(sock);
+      return;
+   }
+
+   int yes = 1;
+   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+   struct sockaddr_in client_addr;
+   socklen_t addrlen = sizeof(client_addr);
+   std::stringstream ss;
+   if (getpeername(sock, (sockaddr*)&client_addr, &addrlen) == 0)
+   {
+      char connected_ip[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &(client_addr.sin_addr), connected_ip, INET_ADDRSTRLEN);
+      ss << connected_ip << ":" << ntohs(client_addr.sin_port);
+   }
+
+   int connID = m_NextConnID++;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      Connection_t& conn = m_Connections[connID];
+      conn.sock = sock;
+      conn.peer = ss.str();
+      conn.sending = false;
+      conn.writeBlocked = false;
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   pthread_mutex_lock(&m_Working_Ring);
+   {
+      armRecv(connID, sock);
+   }
+   pthread_mutex_unlock(&m_Working_Ring);
+
+   ISocket::RecvEvent_t recvEvent;
+   recvEvent.event = ISocket::EVENT_CONNECTED;
+   recvEvent.connID = connID;
+   recvEvent.data = nullptr;
+   recvEvent.numBytes = 0;
+   recvEvent.peer = ss.str();
+   dispatchEvent(recvEvent);
+}
+
+void IoUringSocket::handleRecv(int connID, const io_uring_cqe& cqe)
+{
+   bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+   if (cqe.res > 0)
+   {
+      unsigned short bufID = (unsigned short)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+      // completions still queued when the connection was dropped (by
+      // CloseConnection or a failed send) come after its disconnect
+      // event; only their buffer is of any use
+      bool open;
+      pthread_mutex_lock(&m_Working_Connections);
+      {
+         open = (m_Connections.find(connID) != m_Connections.end());
+      }
+      pthread_mutex_unlock(&m_Working_Connections);
+
+      if (open)
+      {
+         ISocket::RecvEvent_t recvEvent;
+         recvEvent.event = ISocket::EVENT_DATA;
+         recvEvent.connID = connID;
+         recvEvent.data = m_BufBase + (size_t)bufID * URING_BUFFER_SIZE;
+         recvEvent.numBytes = cqe.res;
+         dispatchEvent(recvEvent);
+      }
+
+      recycleBuffer(bufID);
+   }
+   else if (cqe.res == -ENOBUFS)
+   {
+      // ran out of provided buffers; they are recycled by now, so re-arm
+      m_Log->LogDebug("[",m_Name,"] Receive buffers exhausted on connection ", connID);
+   }
+   else
+   {
+      if ((cqe.res < 0) && (cqe.res != -ECANCELED) && (cqe.res != -ECONNRESET))
+         m_Log->LogError("[",m_Name,"] recv failed on connection ", connID, ": ", strerror(-cqe.res));
+
+      // 0 is end of file; either way the connection is done
+      dropConnection(connID);
+      return;
+   }
+
+   if (!more)
+   {
+      int sock = INVALID_SOCKET;
+      pthread_mutex_lock(&m_Working_Connections);
+      {
+         auto it = m_Connections.find(connID);
+         if (it != m_Connections.end())
+            sock = it->second.sock;
+      }
+      pthread_mutex_unlock(&m_Working_Connections);
+
+      if (sock != INVALID_SOCKET)
+      {
+         pthread_mutex_lock(&m_Working_Ring);
+         {
+            armRecv(connID, sock);
+         }
+         pthread_mutex_unlock(&m_Working_Ring);
+      }
+   }
+}
+
+void IoUringSocket::handleSend(int connID, const io_uring_cqe& cqe)
+{
+   bool failed = false;
+   bool writable = false;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it == m_Connections.end())
+      {
+         // connection was dropped while the send was in flight
+         m_RetiredSends.erase(connID);
+      }
+      else
+      {
+         Connection_t& conn = it->second;
+
+         if (cqe.res < 0)
+         {
+            m_Log->LogError("[",m_Name,"] Send failed on connection ", connID, ": ", strerror(-cqe.res));
+            conn.inflight.clear();
+            conn.pending.clear();
+            conn.sending = false;
+            failed = true;
+         }
+         else
+         {
+            conn.inflight.erase(conn.inflight.begin(), conn.inflight.begin() + cqe.res);
+            if (conn.inflight.empty())
+               conn.inflight.swap(conn.pending);
+
+            if (conn.inflight.empty())
+            {
+               conn.sending = false;
+            }
+            else
+            {
+               pthread_mutex_lock(&m_Working_Ring);
+               {
+                  armSend(connID, conn);
+               }
+               pthread_mutex_unlock(&m_Working_Ring);
+            }
+         }
+
+         // a failed connection counts as writable, writeData reports it
+         if (conn.writeBlocked && (failed || (conn.inflight.size() + conn.pending.size() <= URING_SEND_RESUME)))
+         {
+            conn.writeBlocked = false;
+            writable = true;
+         }
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   if (writable)
+      signalWritable();
+
+   if (failed)
+      CloseConnection(connID);
+}
+
+void IoUringSocket::signalWritable()
+{
+   uint64_t one = 1;
+   if (write(m_WritableFd, &one, sizeof(one)) < 0)
+   {
+      // already signalled (counter full), nothing more to do
+   }
+}
+
+void IoUringSocket::dropConnection(int connID)
+{
+   std::string peer;
+   bool found = false;
+   bool writable = false;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it != m_Connections.end())
+      {
+         found = true;
+         peer = it->second.peer;
+         writable = it->second.writeBlocked;
+
+         // the kernel may still be reading an in-flight send buffer
+         if (it->second.sending)
+            m_RetiredSends[connID].swap(it->second.inflight);
+
+         pthread_mutex_lock(&m_Working_Ring);
+         {
+            io_uring_sqe* sqe = getSqe();
+            if (sqe != nullptr)
+            {
+               sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+               sqe->fd        = -1;
+               sqe->addr      = makeUserData(OP_RECV, connID);
+               sqe->user_data = makeUserData(OP_CANCEL, connID);
+               commitSqe(m_SqTail, m_SqPending);
+            }
+         }
+         pthread_mutex_unlock(&m_Working_Ring);
+
+         shutdown(it->second.sock, SHUT_RDWR);
+         close(it->second.sock);
+         m_Connections.erase(it);
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   if (!found)
+      return;
+
+   // a writer waiting on it learns it is gone from writeData
+   if (writable)
+      signalWritable();
+
+   ISocket::RecvEvent_t recvEvent;
+   recvEvent.event = ISocket::EVENT_DISCONNECTED;
+   recvEvent.connID = connID;
+   recvEvent.data = nullptr;
+   recvEvent.numBytes = 0;
+   recvEvent.peer = peer;
+   dispatchEvent(recvEvent);
+}
+
+void IoUringSocket::dispatchEvent(ISocket::RecvEvent_t& recvEvent)
+{
+   if (m_RecvCallbackPtr)
+   {
+      m_RecvCallbackPtr->Invoke((void *)(intptr_t)recvEvent.connID, &recvEvent);
+   }
+   else if (recvEvent.event == ISocket::EVENT_DATA)
+   {
+      // no callback so just print to console...
+      m_Log->LogDebug("[",m_Name,"] Rcvd ", recvEvent.numBytes, " bytes on connection ", recvEvent.connID);
+   }
+}
+
+bool IoUringSocket::sendData(int connID, const char* data, int numBytes)
+{
+   if (numBytes == 0)
+      return true;
+
+   bool retVal = true;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it == m_Connections.end())
+      {
+         m_Log->LogWarn("[",m_Name,"] No connection with ID ", connID, ", dropping ", numBytes, " bytes");
+         retVal = false;
+      }
+      else if (it->second.sending)
+      {
+         it->second.pending.insert(it->second.pending.end(), data, data + numBytes);
+      }
+      else
+      {
+         it->second.inflight.assign(data, data + numBytes);
+
+         // sends queued from inside a PollEvents callback go out with the
+         // submission at the end of that PollEvents, batched
+         pthread_mutex_lock(&m_Working_Ring);
+         {
+            armSend(connID, it->second);
+            if (!m_InPoll || !pthread_equal(pthread_self(), m_PollThread))
+               submitPending();
+         }
+         pthread_mutex_unlock(&m_Working_Ring);
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   return retVal;
+}
+
+int IoUringSocket::writeData(int connID, const struct iovec* iov, int iovcnt)
+{
+   // queued on the connection up to URING_SEND_LIMIT, the ring never
+   // blocks the caller; the rest is left for after WaitWritable
+   int retVal = 0;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it == m_Connections.end())
+      {
+         retVal = -1;
+      }
+      else
+      {
+         Connection_t& conn = it->second;
+         std::vector<char>& out = conn.sending ? conn.pending : conn.inflight;
+
+         size_t queued = conn.inflight.size() + conn.pending.size();
+         size_t room = (queued < URING_SEND_LIMIT) ? URING_SEND_LIMIT - queued : 0;
+         size_t taken = 0;
+         for (int i = 0; (i < iovcnt) && (taken < room); i++)
+         {
+            size_t n = (iov[i].iov_len < room - taken) ? iov[i].iov_len : room - taken;
+            out.insert(out.end(), (const char*)iov[i].iov_base, (const char*)iov[i].iov_base + n);
+            taken += n;
+         }
+
+         size_t total = 0;
+         for (int i = 0; i < iovcnt; i++)
+            total += iov[i].iov_len;
+         if (taken < total)
+            conn.writeBlocked = true;
+
+         if (!conn.sending && !conn.inflight.empty())
+         {
+            pthread_mutex_lock(&m_Working_Ring);
+            {
+               armSend(connID, conn);
+               if (!m_InPoll || !pthread_equal(pthread_self(), m_PollThread))
+                  submitPending();
+            }
+            pthread_mutex_unlock(&m_Working_Ring);
+         }
+
+         retVal = (int)taken;
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   return retVal;
+}
+
+bool IoUringSocket::WaitWritable(std::vector<int>& connIDs, int wakeFd, double timeout_s)
+{
+   // a connection is writable again once handleSend cleared writeBlocked
+   // (or it is gone, which the next writeData reports)
+   std::vector<int> waiting;
+   waiting.swap(connIDs);
+
+   struct pollfd pfds[2];
+   pfds[0].fd = wakeFd;
+   pfds[0].events = POLLIN;
+   pfds[1].fd = m_WritableFd;
+   pfds[1].events = POLLIN;
+
+   for (;;)
+   {
+      pthread_mutex_lock(&m_Working_Connections);
+      {
+         for (size_t i = 0; i < waiting.size(); i++)
+         {
+            auto it = m_Connections.find(waiting[i]);
+            if ((it == m_Connections.end()) || !it->second.writeBlocked)
+               connIDs.push_back(waiting[i]);
+         }
+      }
+      pthread_mutex_unlock(&m_Working_Connections);
+
+      if (!connIDs.empty())
+         return true;
+
+      pfds[0].revents = 0;
+      pfds[1].revents = 0;
+      int ret = poll(pfds, 2, (int)(timeout_s * 1000));
+      if (ret == -1)
+      {
+         if (errno == EINTR)
+            return true;
+
+         m_Log->LogError("[",m_Name,"] poll failed: ", strerror(errno));
+         return false;
+      }
+
+      if (!(pfds[1].revents & POLLIN))
+         return true;     // woken up or timed out
+
+      uint64_t count;
+      if (read(m_WritableFd, &count, sizeof(count)) < 0)
+      {
+         // another waiter took it, the flags are what counts
+      }
+
+      if (waiting.empty())
+         return true;
+   }
+}
+
+bool IoUringSocket::sendData(const char* data __attribute__((unused)), int numBytes __attribute__((unused)))
+{
+   m_Log->LogError("[",m_Name,"] sendData needs a connection ID in server mode");
+   return false;
+}
+
+bool IoUringSocket::readLine(char* rcvBuffer __attribute__((unused)), int buffer_length __attribute__((unused)),
+                             int& numRead, double timeout_s __attribute__((unused)), bool stopOnDisconnect __attribute__((unused)))
+{
+   numRead = 0;
+   m_Log->LogError("[",m_Name,"] readLine not supported, data is delivered through PollEvents");
+   return false;
+}
+
+bool IoUringSocket::readBlock(char* rcvBuffer __attribute__((unused)), int buffer_length __attribute__((unused)),
+                              int& numRead, double timeout_s __attribute__((unused)))
+{
+   numRead = 0;
+   m_Log->LogError("[",m_Name,"] readBlock not supported, data is delivered through PollEvents");
+   return false;
+}
+
+bool IoUringSocket::RegisterRecvCallback(int callbackID, ICallback* callbackPtr)
+{
+   m_RecvCallbackPtr = callbackPtr;
+
+   m_Log->LogDebug("Registered Receive callback: ", callbackID);
+   return true;
+}
+
+bool IoUringSocket::ListenForTraffic()
+{
+   // not implemented on io_uring socket
+   return true;
+}
+
+bool IoUringSocket::ResetConnection()
+{
+   if (m_Port <= 0)
+   {
+      m_Log->LogError("ISocket::NO_LISTENER_PORT_SPECIFIED");
+      return false;
+   }
+
+   if ((m_RingFd == INVALID_SOCKET) && !setupRing())
+   {
+      m_ConnectionState = STATE_NO_CONNECTION;
+      return false;
+   }
+
+   if ((m_ServerSock == INVALID_SOCKET) && !setupListener())
+   {
+      m_ConnectionState = STATE_NO_CONNECTION;
+      return false;
+   }
+
+   m_ConnectionState = STATE_SERVER_LISTENING;
+   return true;
+}
+
+bool IoUringSocket::CloseConnection()
+{
+   // shut the sockets down first, so every send still in flight fails fast
+   int outstanding = 0;
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      for (auto& conn : m_Connections)
+      {
+         m_Log->LogDebug("Closing connection ", conn.first, " (", conn.second.peer, ")");
+         shutdown(conn.second.sock, SHUT_RDWR);
+         if (conn.second.sending)
+            outstanding++;
+      }
+      outstanding += (int)m_RetiredSends.size();
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   if (m_ServerSock != INVALID_SOCKET)
+   {
+      m_Log->LogDebug("Closing open server socket - ", m_ServerSock);
+      close(m_ServerSock);
+      m_ServerSock = INVALID_SOCKET;
+   }
+
+   // the kernel may be reading any in-flight send buffer until its
+   // completion is reaped or the ring is gone; free them only after both
+   reapSends(outstanding, URING_CLOSE_TIMEOUT_S);
+   teardownRing();
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      for (auto& conn : m_Connections)
+         close(conn.second.sock);
+      m_Connections.clear();
+      m_RetiredSends.clear();
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   return true;
+}
+
+//=============================================================================
+// reapSends
+//-----------------------------------------------------------------------------
+// Waits (at most timeout_s) for the completions of the given number of
+// sends, throwing away every other completion.  Only for CloseConnection,
+// once no thread polls the ring any more.
+//=============================================================================
+void IoUringSocket::reapSends(int outstanding, double timeout_s)
+{
+   if ((m_RingFd == INVALID_SOCKET) || (outstanding <= 0))
+      return;
+
+   pthread_mutex_lock(&m_Working_Ring);
+   {
+      submitPending();
+   }
+   pthread_mutex_unlock(&m_Working_Ring);
+
+   struct timespec start, now;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   now = start;
+
+   while ((outstanding > 0) &&
+          ((double)(now.tv_sec - start.tv_sec) + (double)(now.tv_nsec - start.tv_nsec) * 1e-9 < timeout_s))
+   {
+      unsigned head = *m_CqHead;
+      unsigned tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+      if (head == tail)
+      {
+         struct __kernel_timespec ts;
+         ts.tv_sec  = 0;
+         ts.tv_nsec = 10000000;
+
+         struct io_uring_getevents_arg arg;
+         memset(&arg, 0, sizeof(arg));
+         arg.ts = (uint64_t)(uintptr_t)&ts;
+
+         if ((io_uring_enter(m_RingFd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0) &&
+             (errno != ETIME) && (errno != EINTR))
+            break;
+      }
+
+      for (tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE); head != tail; head++)
+      {
+         if ((int)(m_Cqes[head & m_CqMask].user_data >> 56) == OP_SEND)
+            outstanding--;
+      }
+      __atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+   }
+
+   if (outstanding > 0)
+      m_Log->LogWarn("[",m_Name,"] ", outstanding, " send(s) still in flight at close");
+}
+
+bool IoUringSocket::CloseConnection(int connID)
+{
+   // the multishot recv completes with 0 and the completion side cleans up
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it != m_Connections.end())
+      {
+         m_Log->LogDebug("Shutting down connection ", connID, " (", it->second.peer, ")");
+         shutdown(it->second.sock, SHUT_RDWR);
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   return true;
+}
+
+bool IoUringSocket::getConnectionState(ISocket::ConnectionState_t &state)
+{
+   state = m_ConnectionState;
+   return true;
+}
+
+std::string IoUringSocket::GetName()
+{
+   return m_Name;
+}
@@ -0,0 +1,186 @@
+/**************************************************************************
+*
+*		     Source:  IoUringSocket.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > io_uring implementation of an ISocket (server mode only).
+*		    Accept and receive are multishot requests, received data
+*		    lands in a provided buffer ring registered with the kernel,
+*		    so a busy connection costs no syscall per recv.  Talks to
+*		    the kernel ABI directly, no liburing needed.
+*
+****************************************************************************/
+
+#ifndef  IoUringSocket_H
+#define  IoUringSocket_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+#include <pthread.h>
+#include <linux/io_uring.h>
+
+#include "Logger.h"
+#include "ISocket.h"
+#include "Callback.h"
+
+// Submission queue entries; the completion queue is URING_CQ_ENTRIES deep
+#define URING_ENTRIES		256
+#define URING_CQ_ENTRIES	4096
+
+// Provided receive buffers (must be a power of 2)
+#define URING_BUFFER_COUNT	256
+#define URING_BUFFER_SIZE	4096
+#define URING_BUFFER_GROUP	1
+
+#define URING_MAXCONNECTIONS	1024
+
+// Bytes writeData queues per connection (like a socket's send buffer);
+// past this it takes a short count, and the connection turns writable
+// again once its sends drained it to URING_SEND_RESUME
+#define URING_SEND_LIMIT	(256 * 1024)
+#define URING_SEND_RESUME	(URING_SEND_LIMIT / 2)
+
+// How long CloseConnection waits for in-flight sends to complete
+#define URING_CLOSE_TIMEOUT_S	1.0
+
+class  IoUringSocket : public ISocket
+{
+  public:
+             IoUringSocket(const char* name, const bool debug = false);
+    virtual ~IoUringSocket();
+
+    bool init(ConnectionMode_t mode, const std::string IPAddress, const int port);
+
+    bool RegisterRecvCallback(int callbackID, ICallback* callbackPtr);
+
+    bool readLine(char* rcvBuffer, int buffer_length, int& numRead, double timeout_s = 1.0, bool stopOnDisconnect = false);
+    bool readBlock(char* rcvBuffer, int buffer_length, int& numRead, double timeout_s = 1.0);
+
+    bool sendData(const char* data, int numBytes);
+    bool sendData(int connID, const char* data, int numBytes);
+
+    bool PollEvents(double timeout_s = 1.0);
+
+    int writeData(int connID, const struct iovec* iov, int iovcnt);
+    bool WaitWritable(std::vector<int>& connIDs, int wakeFd, double timeout_s);
+
+    bool ListenForTraffic();
+
+    bool ResetConnection ();
+    bool CloseConnection ();
+    bool CloseConnection (int connID);
+
+    bool getConnectionState(ISocket::ConnectionState_t &state );
+
+    std::string GetName();
+
+  protected:
+    // ring operations, kept in the top byte of the request user_data
+    enum RingOp_t
+    {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_SEND,
+        OP_CANCEL
+    };
+
+    struct Connection_t
+    {
+        int               sock;
+        std::string       peer;
+        // at most one send in flight per connection, so the stream stays
+        // in order; anything sent meanwhile is coalesced into pending
+        bool              sending;
+        std::vector<char> inflight;
+        std::vector<char> pending;
+        // writeData hit URING_SEND_LIMIT, see WaitWritable
+        bool              writeBlocked;
+    };
+
+    bool m_Debug;
+    std::string m_Name;
+    std::shared_ptr<Logger> m_Log;
+
+    std::string m_IPAddress;
+    int m_Port;
+
+    ISocket::ConnectionMode_t m_ConnectionMode;
+    ISocket::ConnectionState_t m_ConnectionState;
+
+    int m_ServerSock;
+    int m_RingFd;
+
+    // submission queue
+    void*          m_SqRingPtr;
+    size_t         m_SqRingSize;
+    unsigned*      m_SqHead;
+    unsigned*      m_SqTail;
+    unsigned       m_SqMask;
+    unsigned       m_SqEntries;
+    unsigned       m_SqPending;
+    io_uring_sqe*  m_Sqes;
+    size_t         m_SqesSize;
+
+    // completion queue
+    void*          m_CqRingPtr;
+    size_t         m_CqRingSize;
+    unsigned*      m_CqHead;
+    unsigned*      m_CqTail;
+    unsigned       m_CqMask;
+    io_uring_cqe*  m_Cqes;
+
+    // provided receive buffers
+    io_uring_buf_ring* m_BufRing;
+    size_t             m_BufRingSize;
+    char*              m_BufBase;
+
+    std::map<int, Connection_t> m_Connections;
+    // send buffers of dropped connections, kept until their completion
+    std::map<int, std::vector<char> > m_RetiredSends;
+    int m_NextConnID;
+    pthread_mutex_t m_Working_Connections;
+    pthread_mutex_t m_Working_Ring;
+
+    // signalled when a send drains a writeBlocked connection
+    int m_WritableFd;
+
+    // thread currently inside PollEvents, see sendData
+    pthread_t m_PollThread;
+    bool      m_InPoll;
+
+    ICallback* m_RecvCallbackPtr;
+
+    bool setupRing();
+    void teardownRing();
+    bool setupListener();
+
+    io_uring_sqe* getSqe();
+    bool submitPending();
+    void armAccept();
+    void armRecv(int connID, int sock);
+    void armSend(int connID, Connection_t& conn);
+    void recycleBuffer(unsigned short bufID);
+
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleAccept(const io_uring_cqe& cqe);
+    void handleRecv(int connID, const io_uring_cqe& cqe);
+    void handleSend(int connID, const io_uring_cqe& cqe);
+
+    void reapSends(int outstanding, double timeout_s);
+    void signalWritable();
+
+    void dropConnection(int connID);
+    void dispatchEvent(ISocket::RecvEvent_t& recvEvent);
+};
+
+#endif
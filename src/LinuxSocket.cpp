@@ -21,7 +21,15 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include <fcntl.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "LinuxSocket.h"
 
@@ -37,13 +45,31 @@ m_ConnectionState(ISocket::STATE_NO_CONNECTION),
 m_ConnectTimeoutSeconds(DEFAULT_CONNECTION_TIMEOUT),
 m_ServerSock(INVALID_SOCKET),
 m_ClientSock(INVALID_SOCKET),
+m_EpollFd(INVALID_SOCKET),
+m_NextConnID(1),
+m_LineStart(0),
+m_LineEnd(0),
 m_RecvCallbackPtr(nullptr)
 {
    m_Log = std::shared_ptr<Logger>(new Logger(m_Name, m_Debug));
+
+   pthread_mutex_init(&m_Working_Connections, NULL);
 }
 
 LinuxSocket::~LinuxSocket()
 {
+   for (auto& conn : m_Connections)
+   {
+      close(conn.second.sock);
+   }
+   m_Connections.clear();
+
+   if (m_EpollFd != INVALID_SOCKET)
+   {
+      close(m_EpollFd);
+      m_EpollFd = INVALID_SOCKET;
+   }
+
    if (m_ClientSock != INVALID_SOCKET)
    {
       m_Log->LogDebug("[",m_Name,"] Closing open client socket -", m_ClientSock);
@@ -58,6 +84,7 @@ LinuxSocket::~LinuxSocket()
       m_ServerSock = INVALID_SOCKET;
    }
 
+   pthread_mutex_destroy(&m_Working_Connections);
 }
 
 bool LinuxSocket::init(ConnectionMode_t mode, const std::string IPAddress, const int port)
@@ -68,98 +95,288 @@ bool LinuxSocket::init(ConnectionMode_t mode, const std::string IPAddress, const
 
    if (m_ConnectionMode == CONN_MODE_SERVER)
    {
-      // Create the listening socket
-      m_ServerSock = socket(AF_INET, SOCK_STREAM, 0);
-
-      if (m_ServerSock == INVALID_SOCKET)
+      if (!setupListener())
       {
-         m_Log->LogError("[",m_Name,"] Error creating listening socket");
+         m_ConnectionState = ISocket::ConnectionState_t::STATE_NO_CONNECTION;
          return false;
       }
-
-      // set to non-blocking mode...
-      int status = fcntl(m_ServerSock, F_SETFL, fcntl(m_ServerSock, F_GETFL, 0) | O_NONBLOCK);
-      if (status == -1)
+   }
+   else if (m_ConnectionMode == CONN_MODE_CLIENT)
+   {
+      if (!reconnect())
       {
-         m_Log->LogError("[",m_Name,"] Could not create non-blocking socket...");
-         perror("calling fcntl");
+         m_ConnectionState = ISocket::ConnectionState_t::STATE_NO_CONNECTION;
+         return false;
       }
+      else
+      {
+         m_ConnectionState = ISocket::ConnectionState_t::STATE_CONNECTED;
+      }
+   }
 
-      // allow reuse of this socket
-      int yes = 1;
-      setsockopt(m_ServerSock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+   return true;
+}
 
-      m_server_addr.sin_family = AF_INET;
-      m_server_addr.sin_port = htons(port);
-      m_server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+bool LinuxSocket::setupListener()
+{
+   // Create the listening socket
+   m_ServerSock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
-      m_Log->LogInfo("[",m_Name,"] Setting up server socket on port: ", m_Port );
+   if (m_ServerSock == INVALID_SOCKET)
+   {
+      m_Log->LogError("[",m_Name,"] Error creating listening socket");
+      return false;
+   }
 
-      if (SOCKET_ERROR == bind(m_ServerSock, (struct sockaddr*) &m_server_addr, sizeof(m_server_addr)))
-      {
-         m_Log->LogError("[",m_Name,"] Unable to bind socket");
-         return false;
-      }
+   // allow reuse of this socket
+   int yes = 1;
+   setsockopt(m_ServerSock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+   memset(&m_server_addr, '\0', sizeof(m_server_addr));
+   m_server_addr.sin_family = AF_INET;
+   m_server_addr.sin_port = htons(m_Port);
+   m_server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+   m_Log->LogInfo("[",m_Name,"] Setting up server socket on port: ", m_Port );
+
+   if (SOCKET_ERROR == bind(m_ServerSock, (struct sockaddr*) &m_server_addr, sizeof(m_server_addr)))
+   {
+      m_Log->LogError("[",m_Name,"] Unable to bind socket: ", strerror(errno));
+      close(m_ServerSock);
+      m_ServerSock = INVALID_SOCKET;
+      return false;
+   }
+
+   // To listen on a socket
+   if (listen(m_ServerSock, SOMAXCONN) == SOCKET_ERROR)
+   {
+      m_Log->LogError("[",m_Name,"] Listen failed...");
+      close(m_ServerSock);
+      m_ServerSock = INVALID_SOCKET;
+      return false;
+   }
 
-      // To listen on a socket
-      if (listen(m_ServerSock, SOMAXCONN) == SOCKET_ERROR)
+   // the reactor: the listening socket and every accepted connection are
+   // registered with one epoll instance.  The listener is tagged with
+   // connection ID 0, accepted connections with their own ID.
+   if (m_EpollFd == INVALID_SOCKET)
+   {
+      m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+      if (m_EpollFd == INVALID_SOCKET)
       {
-         m_Log->LogError("[",m_Name,"] Listen failed...");
+         m_Log->LogError("[",m_Name,"] epoll_create1 failed: ", strerror(errno));
          close(m_ServerSock);
          m_ServerSock = INVALID_SOCKET;
          return false;
       }
+   }
 
-      m_Log->LogDebug("Listening for client...");
-      m_ConnectionState = ISocket::ConnectionState_t::STATE_SERVER_PORT_SETUP;
+   struct epoll_event ev;
+   ev.events = EPOLLIN;
+   ev.data.u64 = 0;
+   if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, m_ServerSock, &ev) == -1)
+   {
+      m_Log->LogError("[",m_Name,"] Unable to register listening socket: ", strerror(errno));
+      close(m_ServerSock);
+      m_ServerSock = INVALID_SOCKET;
+      return false;
    }
-   else if (m_ConnectionMode == CONN_MODE_CLIENT)
+
+   m_Log->LogDebug("Listening for clients...");
+   m_ConnectionState = ISocket::ConnectionState_t::STATE_SERVER_LISTENING;
+
+   return true;
+}
+
+bool LinuxSocket::PollEvents(double timeout_s)
+{
+   struct epoll_event events[MAXEVENTS];
+
+   if ((m_ConnectionMode != CONN_MODE_SERVER) || (m_EpollFd == INVALID_SOCKET))
    {
-      if (!reconnect())
-      {
-         m_ConnectionState = ISocket::ConnectionState_t::STATE_NO_CONNECTION;
-         return false;
-      }
+      m_Log->LogError("[",m_Name,"] PollEvents failed: ConnMode != server, or reactor not set up");
+      return false;
+   }
+
+   int numEvents = epoll_wait(m_EpollFd, events, MAXEVENTS, (int)(timeout_s * 1000));
+   if (numEvents == -1)
+   {
+      if (errno == EINTR)
+         return true;
+
+      m_Log->LogError("[",m_Name,"] epoll_wait failed: ", strerror(errno));
+      return false;
+   }
+
+   for (int i = 0; i < numEvents; i++)
+   {
+      int connID = (int)events[i].data.u64;
+
+      if (connID == 0)
+         acceptClients();
       else
-      {
-         m_ConnectionState = ISocket::ConnectionState_t::STATE_CONNECTED;
-      }
+         serviceConnection(connID, events[i].events);
    }
 
    return true;
 }
 
-bool LinuxSocket::ListenForClient(std::string& client_IP)
+void LinuxSocket::acceptClients()
 {
-   if ((m_ConnectionMode == CONN_MODE_SERVER) && (m_ServerSock != INVALID_SOCKET))
+   while (true)
    {
       struct sockaddr_in client_addr;
-      unsigned int addrlen = sizeof(client_addr);
+      socklen_t addrlen = sizeof(client_addr);
 
-      // Accept a client socket
-      m_ClientSock = accept(m_ServerSock, (sockaddr*)&client_addr, &addrlen);
+      int sock = accept4(m_ServerSock, (sockaddr*)&client_addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (sock == INVALID_SOCKET)
+      {
+         if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            m_Log->LogError("[",m_Name,"] accept4 failed: ", strerror(errno));
+         return;
+      }
 
-      if (m_ClientSock != INVALID_SOCKET)
+      if (m_Connections.size() >= MAXCONNECTIONS)
       {
-         fcntl(m_ClientSock, F_SETFL, O_NONBLOCK);
+         m_Log->LogWarn("[",m_Name,"] Too many connections, rejecting client");
+         close(sock);
+         continue;
+      }
 
-         char connected_ip[INET_ADDRSTRLEN];
-         inet_ntop(AF_INET, &(m_client_addr.sin_addr), connected_ip, INET_ADDRSTRLEN);
-         int port = ntohs(client_addr.sin_port);
-         std::stringstream ss;
-         ss << connected_ip << ":" << port;
-         client_IP = ss.str();
+      int yes = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
 
-         m_ConnectionState = ISocket::ConnectionState_t::STATE_CONNECTED;
+      char connected_ip[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &(client_addr.sin_addr), connected_ip, INET_ADDRSTRLEN);
+      std::stringstream ss;
+      ss << connected_ip << ":" << ntohs(client_addr.sin_port);
+
+      int connID = m_NextConnID++;
+
+      // edge triggered: serviceConnection always drains the socket
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+      ev.data.u64 = connID;
+      if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, sock, &ev) == -1)
+      {
+         m_Log->LogError("[",m_Name,"] Unable to register client socket: ", strerror(errno));
+         close(sock);
+         continue;
+      }
+
+      pthread_mutex_lock(&m_Working_Connections);
+      {
+         Connection_t& conn = m_Connections[connID];
+         conn.sock = sock;
+         conn.peer = ss.str();
       }
+      pthread_mutex_unlock(&m_Working_Connections);
+
+      ISocket::RecvEvent_t recvEvent;
+      recvEvent.event = ISocket::EVENT_CONNECTED;
+      recvEvent.connID = connID;
+      recvEvent.data = nullptr;
+      recvEvent.numBytes = 0;
+      recvEvent.peer = ss.str();
+      dispatchEvent(recvEvent);
    }
-   else
+}
+
+void LinuxSocket::serviceConnection(int connID, unsigned int events)
+{
+   int sock = INVALID_SOCKET;
+
+   pthread_mutex_lock(&m_Working_Connections);
    {
-      m_Log->LogError("[",m_Name,"] Listen failed: ConnMode != server, or server socket invalid");
-      return false;
+      auto it = m_Connections.find(connID);
+      if (it != m_Connections.end())
+         sock = it->second.sock;
    }
+   pthread_mutex_unlock(&m_Working_Connections);
 
-   return true;
+   if (sock == INVALID_SOCKET)
+      return;
+
+   if (m_RecvBuffer.empty())
+      m_RecvBuffer.resize(RECV_BUFFER_SIZE);
+
+   bool closed = (events & (EPOLLHUP | EPOLLERR)) != 0;
+
+   if (events & (EPOLLIN | EPOLLRDHUP))
+   {
+      while (true)
+      {
+         int inBytes = recv(sock, m_RecvBuffer.data(), m_RecvBuffer.size(), 0);
+
+         if (inBytes > 0)
+         {
+            ISocket::RecvEvent_t recvEvent;
+            recvEvent.event = ISocket::EVENT_DATA;
+            recvEvent.connID = connID;
+            recvEvent.data = m_RecvBuffer.data();
+            recvEvent.numBytes = inBytes;
+            dispatchEvent(recvEvent);
+            continue;
+         }
+
+         if (inBytes == 0)
+         {
+            closed = true;
+         }
+         else if (errno == EINTR)
+         {
+            continue;
+         }
+         else if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+         {
+            m_Log->LogError("[",m_Name,"] recv failed: ", strerror(errno));
+            closed = true;
+         }
+         break;
+      }
+   }
+
+   if (closed)
+      dropConnection(connID);
+}
+
+void LinuxSocket::dropConnection(int connID)
+{
+   std::string peer;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it != m_Connections.end())
+      {
+         peer = it->second.peer;
+         epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, it->second.sock, NULL);
+         close(it->second.sock);
+         m_Connections.erase(it);
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   ISocket::RecvEvent_t recvEvent;
+   recvEvent.event = ISocket::EVENT_DISCONNECTED;
+   recvEvent.connID = connID;
+   recvEvent.data = nullptr;
+   recvEvent.numBytes = 0;
+   recvEvent.peer = peer;
+   dispatchEvent(recvEvent);
+}
+
+void LinuxSocket::dispatchEvent(ISocket::RecvEvent_t& recvEvent)
+{
+   if (m_RecvCallbackPtr)
+   {
+      m_RecvCallbackPtr->Invoke((void *)(intptr_t)recvEvent.connID, &recvEvent);
+   }
+   else if (recvEvent.event == ISocket::EVENT_DATA)
+   {
+      // no callback so just print to console...
+      m_Log->LogDebug("[",m_Name,"] Rcvd ", recvEvent.numBytes, " bytes on connection ", recvEvent.connID);
+   }
 }
 
 bool LinuxSocket::ListenForTraffic()
@@ -192,84 +409,317 @@ bool LinuxSocket::sendData(const char* data, int numBytes)
    return true;
 }
 
+bool LinuxSocket::sendData(int connID, const char* data, int numBytes)
+{
+   // client mode has a single connection
+   if (m_ConnectionMode == CONN_MODE_CLIENT)
+      return sendData(data, numBytes);
+
+   if (numBytes == 0)
+      return true;
+
+   bool retVal = true;
+
+   // the lock keeps the reactor from closing (and the kernel from reusing)
+   // the descriptor while we are writing to it
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it == m_Connections.end())
+      {
+         m_Log->LogWarn("[",m_Name,"] No connection with ID ", connID, ", dropping ", numBytes, " bytes");
+         retVal = false;
+      }
+      else if (send(it->second.sock, data, numBytes, MSG_NOSIGNAL) == SOCKET_ERROR)
+      {
+         m_Log->LogError("[",m_Name,"] Send failed on connection ", connID, ": ", strerror(errno));
+         retVal = false;
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   return retVal;
+}
+
+//=============================================================================
+// findLineEnd
+//-----------------------------------------------------------------------------
+// Returns the index of the first '\n' or '\r' in p[0..n), or n if there is
+// none.  16 (SSE2) or 32 (AVX2) bytes per compare; AVX2 is picked at run
+// time so the binary still runs on older CPUs.
+//=============================================================================
+static size_t findLineEnd_scalar(const char* p, size_t n, size_t i)
+{
+   for (; i < n; i++)
+   {
+      if ((p[i] == '\n') || (p[i] == '\r'))
+         return i;
+   }
+   return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static size_t findLineEnd_sse2(const char* p, size_t n)
+{
+   const __m128i nl = _mm_set1_epi8('\n');
+   const __m128i cr = _mm_set1_epi8('\r');
+   size_t i = 0;
+
+   for (; i + 16 <= n; i += 16)
+   {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+      int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, nl), _mm_cmpeq_epi8(chunk, cr)));
+      if (mask != 0)
+         return i + __builtin_ctz(mask);
+   }
+   return findLineEnd_scalar(p, n, i);
+}
+
+__attribute__((target("avx2")))
+static size_t findLineEnd_avx2(const char* p, size_t n)
+{
+   const __m256i nl = _mm256_set1_epi8('\n');
+   const __m256i cr = _mm256_set1_epi8('\r');
+   size_t i = 0;
+
+   for (; i + 32 <= n; i += 32)
+   {
+      __m256i chunk = _mm256_loadu_si256((const __m256i*)(p + i));
+      unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, nl), _mm256_cmpeq_epi8(chunk, cr)));
+      if (mask != 0)
+         return i + __builtin_ctz(mask);
+   }
+   return findLineEnd_scalar(p, n, i);
+}
+
+static size_t findLineEnd(const char* p, size_t n)
+{
+   static const bool useAVX2 = __builtin_cpu_supports("avx2");
+   return useAVX2 ? findLineEnd_avx2(p, n) : findLineEnd_sse2(p, n);
+}
+#else
+static size_t findLineEnd(const char* p, size_t n)
+{
+   return findLineEnd_scalar(p, n, 0);
+}
+#endif
+
+static long long elapsed_us(const struct timespec& since)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - since.tv_sec) * 1000000LL + (now.tv_nsec - since.tv_nsec) / 1000;
+}
+
+int LinuxSocket::writeData(int connID, const struct iovec* iov, int iovcnt)
+{
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = (struct iovec*)iov;
+   msg.msg_iovlen = iovcnt;
+
+   int sock = INVALID_SOCKET;
+   ssize_t sent = -1;
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      if (m_ConnectionMode == CONN_MODE_CLIENT)
+      {
+         sock = m_ClientSock;
+      }
+      else
+      {
+         auto it = m_Connections.find(connID);
+         if (it != m_Connections.end())
+            sock = it->second.sock;
+      }
+
+      if (sock != INVALID_SOCKET)
+      {
+         do
+         {
+            sent = sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+         } while ((sent == -1) && (errno == EINTR));
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   if (sock == INVALID_SOCKET)
+      return -1;
+
+   if (sent == -1)
+   {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+         return 0;
+
+      m_Log->LogError("[",m_Name,"] Send failed on connection ", connID, ": ", strerror(errno));
+      return -1;
+   }
+
+   return (int)sent;
+}
+
+bool LinuxSocket::WaitWritable(std::vector<int>& connIDs, int wakeFd, double timeout_s)
+{
+   // only ever called from the one TX thread, reuse the scratch vectors
+   std::vector<struct pollfd>& pfds = m_WritePollFds;
+   std::vector<int>& ids = m_WritePollIDs;
+   pfds.clear();
+   ids.clear();
+
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      for (int connID : connIDs)
+      {
+         struct pollfd pfd;
+         pfd.fd = INVALID_SOCKET;
+         if (m_ConnectionMode == CONN_MODE_CLIENT)
+         {
+            pfd.fd = m_ClientSock;
+         }
+         else
+         {
+            auto it = m_Connections.find(connID);
+            if (it != m_Connections.end())
+               pfd.fd = it->second.sock;
+         }
+         pfd.events = POLLOUT;
+         pfd.revents = 0;
+         pfds.push_back(pfd);
+         ids.push_back(connID);
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   struct pollfd wake;
+   wake.fd = wakeFd;
+   wake.events = POLLIN;
+   wake.revents = 0;
+   pfds.push_back(wake);
+
+   // a connection that went away in the meantime (fd -1) is ignored by poll
+   int ret = poll(pfds.data(), pfds.size(), (int)(timeout_s * 1000));
+
+   connIDs.clear();
+   if (ret == -1)
+   {
+      if (errno == EINTR)
+         return true;
+
+      m_Log->LogError("[",m_Name,"] poll failed: ", strerror(errno));
+      return false;
+   }
+
+   for (size_t i = 0; i < ids.size(); i++)
+   {
+      // errors count as writable, the next writeData reports them
+      if (pfds[i].revents & (POLLOUT | POLLERR | POLLHUP))
+         connIDs.push_back(ids[i]);
+   }
+
+   return true;
+}
+
 bool LinuxSocket::readLine(char* rcvBuffer, int buffer_length, int& numRead, double timeout_s, bool stopOnDisconnect)
 {
-   int     timeout_us;
-   int     result;
-   int     socketError __attribute__((unused));
-   bool    firstChar = false;
-   bool    done = false;
+   long long timeout_us;
+   bool      firstChar = false;
 
    timeout_us = timeout_s * 1e6;
-
-   memset(rcvBuffer, '\0', buffer_length);
    numRead = 0;
 
+   // one byte is kept for the terminator, which every return path writes
+   if (buffer_length <= 0)
+      return false;
+   rcvBuffer[0] = '\0';
+
+   if (m_LineBuffer.empty())
+      m_LineBuffer.resize(LINE_BUFFER_SIZE);
+
    while (true)
    {
-      result = read(m_ClientSock, &rcvBuffer[numRead], 1);
-      switch (result)
+      // first hand out whatever is left over from the last read
+      if (m_LineStart < m_LineEnd)
+      {
+         if (!firstChar)
+         {
+            firstChar = true;
+            timeout_us = timeout_s * 1e6;
+         }
+
+         size_t avail = m_LineEnd - m_LineStart;
+         size_t room  = buffer_length - 1 - numRead;
+         size_t n     = (avail < room) ? avail : room;
+         const char* src = m_LineBuffer.data() + m_LineStart;
+
+         size_t pos = findLineEnd(src, n);
+         memcpy(&rcvBuffer[numRead], src, pos);
+         numRead += pos;
+
+         if (pos < n)
+         {
+            // consume the delimiter as well
+            m_LineStart += pos + 1;
+            rcvBuffer[numRead] = '\0';
+            return true;
+         }
+
+         m_LineStart += n;
+         rcvBuffer[numRead] = '\0';
+         if (numRead >= buffer_length - 1)
+            return true;
+      }
+
+      // buffer is drained, refill it with one big read
+      m_LineStart = m_LineEnd = 0;
+
+      struct timespec waitStart;
+      clock_gettime(CLOCK_MONOTONIC, &waitStart);
+
+      int result = read(m_ClientSock, m_LineBuffer.data(), m_LineBuffer.size());
+      if (result > 0)
+      {
+         m_LineEnd = result;
+         continue;
+      }
+
+      if (result == 0)
+      {
+         m_ConnectionState = ISocket::ConnectionState_t::STATE_NO_CONNECTION;
+         if (stopOnDisconnect)
+         {
+            numRead = -1;
+            return false;
+         }
+         usleep(250);
+         timeout_us -= 250;
+      }
+      else
       {
-      case -1:
          switch (errno)
          {
          case EINTR:
             break;
 
          case EAGAIN:
-            //case EWOULDBLOCK:
-            usleep(250);
-            timeout_us -= 250;
+            {
+               // wait for data instead of spinning
+               struct pollfd pfd;
+               pfd.fd = m_ClientSock;
+               pfd.events = POLLIN;
+               pfd.revents = 0;
+               int wait_ms = (timeout_us > 0) ? (int)((timeout_us + 999) / 1000) : 0;
+               poll(&pfd, 1, wait_ms);
+               timeout_us -= elapsed_us(waitStart);
+            }
             break;
 
          default:
             m_Log->LogError("[",m_Name,"] socket read failed: ", strerror(errno));
             return false;
          }
-         break;
-
-         case 0:
-            m_ConnectionState = ISocket::ConnectionState_t::STATE_NO_CONNECTION;
-            if (stopOnDisconnect)
-            {
-               numRead = -1;
-               return false;
-            }
-            else
-            {
-               usleep(250);
-               timeout_us -= 250;
-               break;
-            }
-         case 1:
-            if (!firstChar)
-            {
-               firstChar = true;
-               timeout_us = timeout_s * 1e6;
-            }
-
-            switch (rcvBuffer[numRead])
-            {
-            case '\n':
-            case '\r':
-            rcvBuffer[numRead] = '\0';
-            done = true;
-            break;
-            default:
-               numRead++;
-               if (numRead >= buffer_length) // should never be greater since we read 1 byte at a time
-                  done = true;
-               break;
-            }
-            break;
-            default:
-               m_Log->LogDebug("[",m_Name,"] Too many bytes read: ", numRead);
-               return false;
       }
 
-      if (done)
-         break;
-
       if (timeout_us <= 0)
       {
          if (numRead > 0)
@@ -284,14 +734,6 @@ bool LinuxSocket::readLine(char* rcvBuffer, int buffer_length, int& numRead, dou
          }
       }
    }
-
-   if (!done)
-   {
-      m_Log->LogError("[",m_Name,"] Buffer full before end of line found");
-      return false;
-   }
-
-   return true;
 }
 #include <cstring>
 
@@ -301,6 +743,16 @@ bool LinuxSocket::readBlock(char* rcvBuffer, int buffer_length, int& numRead, do
 
    numRead = 0;
 
+   // bytes readLine buffered but did not hand out yet come first
+   if (m_LineStart < m_LineEnd)
+   {
+      size_t avail = m_LineEnd - m_LineStart;
+      numRead = (avail < (size_t)buffer_length) ? avail : buffer_length;
+      memcpy(rcvBuffer, m_LineBuffer.data() + m_LineStart, numRead);
+      m_LineStart += numRead;
+      return true;
+   }
+
    do
    {
       if (m_ClientSock != SOCKET_ERROR)
@@ -377,8 +829,15 @@ bool LinuxSocket::ResetConnection()
          m_Log->LogError("ISocket::NO_LISTENER_PORT_SPECIFIED");
          return false;
       }
-      m_Log->LogDebug("Listening for client...");
-      m_ConnectionState = STATE_SERVER_PORT_SETUP;
+      if (m_ServerSock == INVALID_SOCKET)
+      {
+         if (!setupListener())
+         {
+            m_ConnectionState = STATE_NO_CONNECTION;
+            return false;
+         }
+      }
+      m_ConnectionState = STATE_SERVER_LISTENING;
    }
 
    return true;
@@ -386,12 +845,30 @@ bool LinuxSocket::ResetConnection()
 
 bool LinuxSocket::CloseConnection()
 {
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      for (auto& conn : m_Connections)
+      {
+         m_Log->LogDebug("Closing connection ", conn.first, " (", conn.second.peer, ")");
+         close(conn.second.sock);
+      }
+      m_Connections.clear();
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   if (m_EpollFd != INVALID_SOCKET)
+   {
+      close(m_EpollFd);
+      m_EpollFd = INVALID_SOCKET;
+   }
+
    if (m_ClientSock != INVALID_SOCKET)
    {
       m_Log->LogDebug("Closing open client socket -", m_ClientSock);
       close(m_ClientSock);
       m_ClientSock = INVALID_SOCKET;
    }
+   m_LineStart = m_LineEnd = 0;
 
    if (m_ServerSock != INVALID_SOCKET)
    {
@@ -403,6 +880,24 @@ bool LinuxSocket::CloseConnection()
    return true;
 }
 
+bool LinuxSocket::CloseConnection(int connID)
+{
+   // only shut the connection down here; the reactor sees the hangup and
+   // releases the descriptor from its own thread
+   pthread_mutex_lock(&m_Working_Connections);
+   {
+      auto it = m_Connections.find(connID);
+      if (it != m_Connections.end())
+      {
+         m_Log->LogDebug("Shutting down connection ", connID, " (", it->second.peer, ")");
+         shutdown(it->second.sock, SHUT_RDWR);
+      }
+   }
+   pthread_mutex_unlock(&m_Working_Connections);
+
+   return true;
+}
+
 bool LinuxSocket::getConnectionState(ISocket::ConnectionState_t &state)
 {
    state = m_ConnectionState;
@@ -425,6 +920,7 @@ bool LinuxSocket::reconnect()
       close(m_ClientSock);
       m_ClientSock = -1;
    }
+   m_LineStart = m_LineEnd = 0;
 
    m_Log->LogDebug("[",m_Name,"] Using ", m_IPAddress, ":", m_Port);
 
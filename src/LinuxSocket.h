@@ -18,7 +18,11 @@
 #include <sstream>
 #include <string>
 #include <memory>
+#include <map>
+#include <vector>
 
+#include <pthread.h>
+#include <poll.h>
 //#include <unistd.h>
 //#include <sys/types.h>
 //#include <sys/socket.h>
@@ -29,13 +33,20 @@
 #include "ISocket.h"
 #include "Callback.h"
 
-#define MAXCONNECTIONS	1
+#define MAXCONNECTIONS	1024
+#define MAXEVENTS	64
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
 
 // Default connection timeout is 3 seconds
 #define DEFAULT_CONNECTION_TIMEOUT   3
 
+// Size of the scratch buffer the reactor reads into
+#define RECV_BUFFER_SIZE   32768
+
+// Size of the client side receive buffer behind readLine
+#define LINE_BUFFER_SIZE   65536
+
 class  LinuxSocket : public ISocket
 {
   public:
@@ -52,19 +63,30 @@ class  LinuxSocket : public ISocket
     //bool readUntilToken(char* bytes, unsigned int numRequested, int& numread, const char* tokStr, double timeoutSecs);
 
     bool sendData(const char* data, int numBytes);
+    bool sendData(int connID, const char* data, int numBytes);
 
-    bool ListenForClient(std::string& client_IP);
+    bool PollEvents(double timeout_s = 1.0);
+
+    int writeData(int connID, const struct iovec* iov, int iovcnt);
+    bool WaitWritable(std::vector<int>& connIDs, int wakeFd, double timeout_s);
 
     bool ListenForTraffic();
 
     bool ResetConnection ();
     bool CloseConnection ();
+    bool CloseConnection (int connID);
 
     bool getConnectionState(ISocket::ConnectionState_t &state );
 
     std::string GetName();
 
   protected:
+    struct Connection_t
+    {
+        int         sock;
+        std::string peer;
+    };
+
     bool m_Debug;
     std::string m_Name;
     std::shared_ptr<Logger> m_Log;
@@ -80,15 +102,35 @@ class  LinuxSocket : public ISocket
 
     int m_ServerSock;
     int m_ClientSock;
+    int m_EpollFd;
 
     sockaddr_in m_server_addr; // Socket Struct
-    sockaddr_in m_client_addr; // Socket Struct
+
+    // server mode: accepted connections, keyed by connection ID
+    std::map<int, Connection_t> m_Connections;
+    int m_NextConnID;
+    pthread_mutex_t m_Working_Connections;
+    std::vector<char> m_RecvBuffer;
+
+    // WaitWritable scratch
+    std::vector<struct pollfd> m_WritePollFds;
+    std::vector<int> m_WritePollIDs;
+
+    // client mode: bytes read ahead by readLine, [m_LineStart, m_LineEnd)
+    std::vector<char> m_LineBuffer;
+    size_t m_LineStart;
+    size_t m_LineEnd;
 
     struct timeval m_readTimeout;
 
     ICallback* m_RecvCallbackPtr;
 
     bool reconnect();
+    bool setupListener();
+    void acceptClients();
+    void serviceConnection(int connID, unsigned int events);
+    void dropConnection(int connID);
+    void dispatchEvent(ISocket::RecvEvent_t& recvEvent);
 };
 
 #endif
@@ -4,11 +4,66 @@
 #include <string>  // string
 #include <iomanip> // std::setw, put_time
 
-// these will be used if I ever add timestamping...
-#include <ctime>   // localtime
-#include <chrono>  // chrono::system_clock
+#include <ctime>   // localtime_r, strftime
 #include <sstream> // stringstream
 
+#include <time.h>  // clock_gettime
+
+#include <cstdarg>  // va_list
+
+#include "AsyncLog.h"
+#include "BinaryLog.h"
+
+// Log levels, lowest first
+#define LOG_LEVEL_DEBUG  0
+#define LOG_LEVEL_INFO   1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_ERROR  3
+
+// LOG_* macros below this level compile to nothing
+// (e.g. make LOG_MIN_LEVEL=LOG_LEVEL_INFO)
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL  LOG_LEVEL_DEBUG
+#endif
+
+// Lazy logging: the arguments are only evaluated when the message is
+// printed, so a disabled LOG_DEBUG costs one well-predicted branch on the
+// logger's debug flag (nothing at all below LOG_MIN_LEVEL).  Use these
+// instead of calling LogX directly wherever building the arguments costs
+// something (DebugString(), ByteSizeLong(), ...) or the call is on a hot path.
+#define LOG_AT(level, logger, method, ...) \
+    do { \
+        if (((level) >= LOG_MIN_LEVEL) && (logger)->Enabled(level)) \
+            (logger)->method(__VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(logger, ...)  LOG_AT(LOG_LEVEL_DEBUG, logger, LogDebug, __VA_ARGS__)
+#define LOG_INFO(logger, ...)   LOG_AT(LOG_LEVEL_INFO,  logger, LogInfo,  __VA_ARGS__)
+#define LOG_WARN(logger, ...)   LOG_AT(LOG_LEVEL_WARN,  logger, LogWarn,  __VA_ARGS__)
+#define LOG_ERROR(logger, ...)  LOG_AT(LOG_LEVEL_ERROR, logger, LogError, __VA_ARGS__)
+
+// Hot-path tracing with a printf format and plain (printf-able) arguments.
+// With a BinaryLog open, the call site registers its format once and each
+// call only copies the raw arguments into the binary log (decode it with
+// bin/log_decode); otherwise it is formatted as debug output.  Arguments
+// are evaluated one extra time, on the call site's first trace.
+#define LOG_TRACE(logger, format, ...) \
+    do { \
+        if (LOG_LEVEL_DEBUG >= LOG_MIN_LEVEL) \
+        { \
+            if (BinaryLog::Active()) \
+            { \
+                static const uint16_t binaryLogID = \
+                    BinaryLog::Register(format, __FILE__, __LINE__, BinaryLog::ArgTypes(__VA_ARGS__)); \
+                BinaryLog::Write(binaryLogID, ##__VA_ARGS__); \
+            } \
+            else if ((logger)->Enabled(LOG_LEVEL_DEBUG)) \
+            { \
+                (logger)->LogDebugf(format, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
 class Logger
 {
 public:
@@ -16,18 +71,33 @@ public:
     Logger(std::string name) :m_Name(name) {};
     ~Logger(){};
 
+    // only debug output can be switched off at run time
+    bool Enabled(int level) const
+    {
+        return (level > LOG_LEVEL_DEBUG) || __builtin_expect(m_Debug, false);
+    }
+
     template <typename T> void LogError(const T& t)
     {
+        if (AsyncLog::Active())
+            return logAsync("[ERROR] ", t);
+
         std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [ERROR] " << t << std::endl;
     }
 
     template <typename T> void LogWarn(const T& t)
     {
+        if (AsyncLog::Active())
+            return logAsync("[WARN ] ", t);
+
         std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [WARN ] " << t << std::endl;
     }
 
     template <typename T> void LogInfo(const T& t)
     {
+        if (AsyncLog::Active())
+            return logAsync("[INFO ] ", t);
+
         std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [INFO ] " << t << std::endl;
     }
 
@@ -35,24 +105,36 @@ public:
     {
         if (m_Debug)
         {
+            if (AsyncLog::Active())
+                return logAsync("[DEBUG] ", t);
+
             std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [DEBUG] " << t << std::endl;
         }
     }
 
     template <typename First, typename... Rest> void LogError(const First& first, const Rest&... rest)
     {
+        if (AsyncLog::Active())
+            return logAsync("[ERROR] ", first, rest...);
+
         std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [ERROR] " << first;
         Finish(rest...); // recursive call using pack expansion syntax
     }
 
     template <typename First, typename... Rest> void LogWarn(const First& first, const Rest&... rest)
     {
+        if (AsyncLog::Active())
+            return logAsync("[WARN ] ", first, rest...);
+
         std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [WARN ] " << first;
         Finish(rest...); // recursive call using pack expansion syntax
     }
 
     template <typename First, typename... Rest> void LogInfo(const First& first, const Rest&... rest)
     {
+        if (AsyncLog::Active())
+            return logAsync("[INFO ] ", first, rest...);
+
         std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [INFO ] " << first;
         Finish(rest...); // recursive call using pack expansion syntax
     }
@@ -61,15 +143,66 @@ public:
     {
         if (m_Debug)
         {
+            if (AsyncLog::Active())
+                return logAsync("[DEBUG] ", first, rest...);
+
             std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") [DEBUG] " << first;
             Finish(rest...); // recursive call using pack expansion syntax
         }
     }
 
+    // printf style debug output (LOG_TRACE when there is no binary log)
+    void LogDebugf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        if (m_Debug)
+        {
+            char text[512];
+            va_list args;
+            va_start(args, format);
+            vsnprintf(text, sizeof(text), format, args);
+            va_end(args);
+
+            LogDebug(text);
+        }
+    }
+
+    // "YYYY-mm-dd HH:MM:SS.uuuuuu" in a per-thread buffer.  localtime (and
+    // its global lock) and strftime only run when the second changes, every
+    // other call just fills in the microseconds.
+    static const char* FormatTimeStamp(const struct timespec& ts)
+    {
+        static __thread time_t cachedSecond = -1;
+        static __thread size_t prefixLen = 0;
+        static __thread char text[40];
+
+        if (ts.tv_sec != cachedSecond)
+        {
+            struct tm local;
+            localtime_r(&ts.tv_sec, &local);
+            prefixLen = std::strftime(text, sizeof(text) - 7, "%F %T.", &local);
+            cachedSecond = ts.tv_sec;
+        }
+
+        unsigned long usec = ts.tv_nsec / 1000;
+        char* digit = text + prefixLen + 6;
+        *digit = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            *--digit = (char)('0' + usec % 10);
+            usec /= 10;
+        }
+        return text;
+    }
+
 private:
     std::string m_Name;
     bool m_Debug = false;
 
+    void Finish()
+    {
+        std::clog << std::endl;
+    }
+
     template <typename T> void Finish(const T& t)
     {
         std::clog << t << std::endl;
@@ -81,27 +214,38 @@ private:
         Finish(rest...); // recursive call using pack expansion syntax
     }
 
-    std::string getTimeStamp()
+    // formats into the calling thread's AsyncLog ring, the backend adds
+    // the timestamp and name; a full ring drops the message, one that
+    // raced with AsyncLog::Stop goes to std::clog
+    template <typename First, typename... Rest> void logAsync(const char* tag, const First& first, const Rest&... rest)
     {
-        std::stringstream ss;
-        
-        // until gcc supports put_time, we have to exclude all this...
-        //~ auto p = std::chrono::high_resolution_clock::now();
-        //~ auto now_c = std::chrono::high_resolution_clock::to_time_t(p);
-        //~ auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(p.time_since_epoch());
-        //~ auto s = std::chrono::duration_cast<std::chrono::seconds>(ms);
-        //~ std::time_t t = s.count();
-        //~ std::size_t fractional_seconds = ms.count() % 1000;
+        bool stopped;
+        std::ostream* out = AsyncLog::Begin(tag, m_Name, stopped);
+        if (out)
+        {
+            Put(*out, first, rest...);
+            AsyncLog::Commit();
+        }
+        else if (stopped)
+        {
+            std::clog << getTimeStamp() << ": (" << std::setw(16) << std::left << m_Name << ") " << tag << first;
+            Finish(rest...);
+        }
+    }
 
-		std::time_t t = std::time(NULL);
-		char mbstr[100];
-		if (std::strftime(mbstr, sizeof(mbstr), "%F %T", std::localtime(&t))) {
-			ss <<  mbstr;
-		}
+    static void Put(std::ostream&) {}
 
-        ss << ".";
-        ss << std::right << std::setw(3) << std::setfill('0'); // << fractional_seconds;
-        return ss.str();
+    template <typename First, typename... Rest> static void Put(std::ostream& out, const First& first, const Rest&... rest)
+    {
+        out << first;
+        Put(out, rest...);
+    }
+
+    const char* getTimeStamp()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        return FormatTimeStamp(now);
     }
 };
 
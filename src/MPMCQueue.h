@@ -0,0 +1,201 @@
+/**************************************************************************
+*
+*		     Source:  MPMCQueue.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Bounded lock-free multi-producer/multi-consumer queue
+*		    (D. Vyukov's bounded queue: each cell carries a sequence
+*		    number telling producers and consumers whose turn it is,
+*		    so a push or pop is one CAS plus the copy).  Neither
+*		    Push nor Pop ever blocks; consumers that want to sleep
+*		    use Push's wasEmpty to know when to wake one up.
+*
+****************************************************************************/
+#ifndef __MPMC_QUEUE_H__
+#define __MPMC_QUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+template<typename T>
+class MPMCQueue
+{
+public:
+    struct Stats_t
+    {
+        size_t   depth;         // items queued right now (approximate)
+        size_t   maxDepth;      // high water mark
+        uint64_t pushed;
+        uint64_t popped;
+        uint64_t rejected;      // pushes refused because the queue was full
+    };
+
+    // capacity is rounded up to a power of two
+    explicit MPMCQueue(size_t capacity = 4096) :
+        m_Tail(0),
+        m_Head(0),
+        m_Depth(0),
+        m_MaxDepth(0),
+        m_Pushed(0),
+        m_Popped(0),
+        m_Rejected(0)
+    {
+        size_t rounded = 2;
+        while (rounded < capacity)
+            rounded <<= 1;
+
+        m_Mask = rounded - 1;
+        m_Cells = std::vector<Cell_t>(rounded);
+        for (size_t i = 0; i < rounded; i++)
+            m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    virtual ~MPMCQueue()
+    {
+    }
+
+    size_t capacity() const { return m_Mask + 1; }
+
+    //=========================================================================
+    // Push (any thread)
+    //-------------------------------------------------------------------------
+    // Returns false if the queue is full.  wasEmpty, if given, tells the
+    // producer it made the queue non-empty (e.g. to wake a consumer).
+    //=========================================================================
+    bool Push(const T& item, bool* wasEmpty = NULL)
+    {
+        Cell_t* cell;
+        size_t pos = m_Tail.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            cell = &m_Cells[pos & m_Mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0)
+            {
+                if (m_Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // no consumer has freed this cell yet: full
+                m_Rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = m_Tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        size_t depth = m_Depth.fetch_add(1, std::memory_order_acq_rel) + 1;
+        size_t maxDepth = m_MaxDepth.load(std::memory_order_relaxed);
+        while ((depth > maxDepth) &&
+               !m_MaxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed))
+        {
+        }
+        m_Pushed.fetch_add(1, std::memory_order_relaxed);
+
+        if (wasEmpty)
+            *wasEmpty = (depth == 1);
+
+        return true;
+    }
+
+    //=========================================================================
+    // Pop (any thread)
+    //-------------------------------------------------------------------------
+    // Returns false if there is nothing to pop.
+    //=========================================================================
+    bool Pop(T& item)
+    {
+        Cell_t* cell;
+        size_t pos = m_Head.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            cell = &m_Cells[pos & m_Mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if (diff == 0)
+            {
+                if (m_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                // another consumer took this cell
+                pos = m_Head.load(std::memory_order_relaxed);
+            }
+        }
+
+        item = cell->data;
+        cell->data = T();
+        cell->sequence.store(pos + m_Mask + 1, std::memory_order_release);
+
+        m_Depth.fetch_sub(1, std::memory_order_acq_rel);
+        m_Popped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t Depth() const { return m_Depth.load(std::memory_order_relaxed); }
+
+    Stats_t GetStats() const
+    {
+        Stats_t stats;
+        stats.depth    = m_Depth.load(std::memory_order_relaxed);
+        stats.maxDepth = m_MaxDepth.load(std::memory_order_relaxed);
+        stats.pushed   = m_Pushed.load(std::memory_order_relaxed);
+        stats.popped   = m_Popped.load(std::memory_order_relaxed);
+        stats.rejected = m_Rejected.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Cell_t
+    {
+        std::atomic<size_t> sequence;
+        T                   data;
+
+        Cell_t() : sequence(0) {}
+        Cell_t(const Cell_t& other) : sequence(other.sequence.load()), data(other.data) {}
+    };
+
+    // producers and consumers each get their own cache line (padding
+    // rather than alignas, the queue lives in heap allocated objects)
+    std::vector<Cell_t>   m_Cells;
+    size_t                m_Mask;
+    char                  m_Pad0[64];
+    std::atomic<size_t>   m_Tail;
+    char                  m_Pad1[64];
+    std::atomic<size_t>   m_Head;
+    char                  m_Pad2[64];
+
+    std::atomic<size_t>   m_Depth;
+    std::atomic<size_t>   m_MaxDepth;
+    std::atomic<uint64_t> m_Pushed;
+    std::atomic<uint64_t> m_Popped;
+    std::atomic<uint64_t> m_Rejected;
+
+    MPMCQueue(const MPMCQueue&);
+    MPMCQueue& operator=(const MPMCQueue&);
+};
+
+#endif
@@ -0,0 +1,95 @@
+/**************************************************************************
+*
+*		     Source:  MessagePool.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Free list of protobuf messages for the request path.
+*		    Released messages are Clear()ed, which keeps their strings,
+*		    repeated fields and sub-messages allocated, so a recycled
+*		    message parses or builds the next request without touching
+*		    the heap.
+*
+****************************************************************************/
+#ifndef __MESSAGE_POOL_H__
+#define __MESSAGE_POOL_H__
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include <vector>
+
+template<typename T>
+class MessagePool
+{
+public:
+    // keeps at most maxPooled idle messages around
+    explicit MessagePool(size_t maxPooled = 1024) :
+        m_MaxPooled(maxPooled)
+    {
+        pthread_mutex_init(&m_Working_Pool, NULL);
+        m_Free.reserve(maxPooled);
+    }
+
+    virtual ~MessagePool()
+    {
+        for (size_t i = 0; i < m_Free.size(); i++)
+            delete m_Free[i];
+
+        pthread_mutex_destroy(&m_Working_Pool);
+    }
+
+    // a cleared message, recycled if one is available
+    T* Acquire()
+    {
+        T* msg = NULL;
+
+        pthread_mutex_lock(&m_Working_Pool);
+        {
+            if (!m_Free.empty())
+            {
+                msg = m_Free.back();
+                m_Free.pop_back();
+            }
+        }
+        pthread_mutex_unlock(&m_Working_Pool);
+
+        if (msg == NULL)
+            msg = new T();
+
+        return msg;
+    }
+
+    void Release(T* msg)
+    {
+        if (msg == NULL)
+            return;
+
+        msg->Clear();
+
+        pthread_mutex_lock(&m_Working_Pool);
+        {
+            if (m_Free.size() < m_MaxPooled)
+            {
+                m_Free.push_back(msg);
+                msg = NULL;
+            }
+        }
+        pthread_mutex_unlock(&m_Working_Pool);
+
+        delete msg;
+    }
+
+private:
+    size_t           m_MaxPooled;
+    std::vector<T*>  m_Free;
+    pthread_mutex_t  m_Working_Pool;
+
+    MessagePool(const MessagePool&);
+    MessagePool& operator=(const MessagePool&);
+};
+
+#endif
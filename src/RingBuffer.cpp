@@ -0,0 +1,158 @@
+/**************************************************************************
+*
+*		     Source:  RingBuffer.cpp
+*           Project:  ScorpionServer
+*
+*            Author: trafferty
+*              Date: Oct 17, 2026
+*
+*		Description:
+*			> Double mapped byte ring, see RingBuffer.h
+*
+****************************************************************************/
+
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "RingBuffer.h"
+
+RingBuffer::RingBuffer() :
+   m_Buffer(nullptr),
+   m_Capacity(0),
+   m_Mask(0),
+   m_Head(0),
+   m_Tail(0)
+{
+}
+
+RingBuffer::~RingBuffer()
+{
+    unmapMirrored(m_Buffer, m_Capacity);
+}
+
+static size_t roundCapacity(size_t capacity)
+{
+    size_t rounded = sysconf(_SC_PAGESIZE);
+    while (rounded < capacity)
+        rounded <<= 1;
+    return rounded;
+}
+
+bool RingBuffer::init(size_t capacity)
+{
+    unmapMirrored(m_Buffer, m_Capacity);
+
+    m_Capacity = roundCapacity(capacity);
+    m_Mask = m_Capacity - 1;
+    m_Head = m_Tail = 0;
+
+    m_Buffer = mapMirrored(m_Capacity);
+    if (m_Buffer == nullptr)
+    {
+        m_Capacity = m_Mask = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool RingBuffer::grow(size_t minCapacity)
+{
+    size_t newCapacity = roundCapacity(minCapacity);
+    if (newCapacity <= m_Capacity)
+        return true;
+
+    char* newBuffer = mapMirrored(newCapacity);
+    if (newBuffer == nullptr)
+        return false;
+
+    size_t used = size();
+    if (used > 0)
+        std::memcpy(newBuffer, readPtr(), used);
+
+    unmapMirrored(m_Buffer, m_Capacity);
+
+    m_Buffer = newBuffer;
+    m_Capacity = newCapacity;
+    m_Mask = m_Capacity - 1;
+    m_Head = 0;
+    m_Tail = used;
+
+    return true;
+}
+
+void RingBuffer::consume(size_t numBytes)
+{
+    if (numBytes > size())
+        numBytes = size();
+    m_Head += numBytes;
+
+    // keep the offsets small and the next write contiguous from the start
+    if (m_Head == m_Tail)
+        m_Head = m_Tail = 0;
+}
+
+void RingBuffer::commit(size_t numBytes)
+{
+    if (numBytes > freeSpace())
+        numBytes = freeSpace();
+    m_Tail += numBytes;
+}
+
+size_t RingBuffer::write(const char* data, size_t numBytes)
+{
+    if (numBytes > freeSpace())
+        numBytes = freeSpace();
+
+    // the mirror makes writePtr() contiguous for freeSpace() bytes
+    std::memcpy(writePtr(), data, numBytes);
+    m_Tail += numBytes;
+
+    return numBytes;
+}
+
+//=============================================================================
+// mapMirrored
+//-----------------------------------------------------------------------------
+// Maps the same capacity bytes of a memfd twice in a row, so that
+// buffer[i] and buffer[i + capacity] are the same byte.
+//=============================================================================
+char* RingBuffer::mapMirrored(size_t capacity)
+{
+    int fd = memfd_create("RingBuffer", MFD_CLOEXEC);
+    if (fd == -1)
+        return nullptr;
+
+    if (ftruncate(fd, capacity) == -1)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // reserve 2x address space, then put the file into both halves
+    char* base = (char*)mmap(NULL, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    if ((mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+        (mmap(base + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED))
+    {
+        munmap(base, 2 * capacity);
+        close(fd);
+        return nullptr;
+    }
+
+    // the mappings keep the memory alive
+    close(fd);
+    return base;
+}
+
+void RingBuffer::unmapMirrored(char* buffer, size_t capacity)
+{
+    if (buffer != nullptr)
+        munmap(buffer, 2 * capacity);
+}
@@ -0,0 +1,64 @@
+/**************************************************************************
+*
+*		     Source:  RingBuffer.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Fixed capacity byte ring used as the receive accumulator.
+*		    The buffer is mapped twice, back to back, so the readable
+*		    bytes are always one contiguous view even when they wrap;
+*		    frames can be parsed in place without copying.
+*
+****************************************************************************/
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+class RingBuffer
+{
+public:
+             RingBuffer();
+    virtual ~RingBuffer();
+
+    // capacity is rounded up to a power of two (and at least a page)
+    bool init(size_t capacity);
+
+    // reallocate to hold at least minCapacity bytes, keeping the contents
+    bool grow(size_t minCapacity);
+
+    size_t capacity() const  { return m_Capacity; }
+    size_t size() const      { return (size_t)(m_Tail - m_Head); }
+    size_t freeSpace() const { return m_Capacity - size(); }
+    bool   empty() const     { return m_Tail == m_Head; }
+
+    // contiguous view of the size() readable bytes
+    const char* readPtr() const { return m_Buffer + (m_Head & m_Mask); }
+    void consume(size_t numBytes);
+
+    // contiguous room for freeSpace() bytes; commit() what was written
+    char* writePtr() { return m_Buffer + (m_Tail & m_Mask); }
+    void commit(size_t numBytes);
+
+    // copies up to freeSpace() bytes in, returns the number copied
+    size_t write(const char* data, size_t numBytes);
+
+private:
+    char*    m_Buffer;
+    size_t   m_Capacity;
+    size_t   m_Mask;
+    uint64_t m_Head;
+    uint64_t m_Tail;
+
+    RingBuffer(const RingBuffer&);
+    RingBuffer& operator=(const RingBuffer&);
+
+    static char* mapMirrored(size_t capacity);
+    static void unmapMirrored(char* buffer, size_t capacity);
+};
+
+#endif
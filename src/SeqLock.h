@@ -0,0 +1,91 @@
+/**************************************************************************
+*
+*		     Source:  SeqLock.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Single writer sequence lock for small, trivially copyable
+*		    values.  The writer never blocks; readers copy the value
+*		    without taking a lock and retry if a write overlapped the
+*		    copy.  The sequence number doubles as a version: Load()
+*		    returns how many times the value has been stored.
+*
+****************************************************************************/
+#ifndef __SEQ_LOCK_H__
+#define __SEQ_LOCK_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+
+#include <atomic>
+
+template<typename T>
+class SeqLock
+{
+public:
+    SeqLock() : m_Seq(0)
+    {
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            m_Words[i].store(0, std::memory_order_relaxed);
+    }
+
+    // writer thread only
+    void Store(const T& value)
+    {
+        uint64_t words[NUM_WORDS] = {0};
+        memcpy(words, &value, sizeof(T));
+
+        uint64_t seq = m_Seq.load(std::memory_order_relaxed);
+        m_Seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < NUM_WORDS; i++)
+            m_Words[i].store(words[i], std::memory_order_relaxed);
+
+        m_Seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // any thread; returns the version of the copy (0: never stored)
+    uint64_t Load(T& value) const
+    {
+        uint64_t words[NUM_WORDS];
+
+        for (unsigned spins = 0; ; spins++)
+        {
+            uint64_t seq0 = m_Seq.load(std::memory_order_acquire);
+            if ((seq0 & 1) == 0)
+            {
+                for (size_t i = 0; i < NUM_WORDS; i++)
+                    words[i] = m_Words[i].load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_Seq.load(std::memory_order_relaxed) == seq0)
+                {
+                    memcpy(&value, words, sizeof(T));
+                    return seq0 / 2;
+                }
+            }
+
+            // the writer may have been preempted mid-store
+            if (spins >= 64)
+                sched_yield();
+        }
+    }
+
+    uint64_t Version() const { return m_Seq.load(std::memory_order_acquire) / 2; }
+
+private:
+    enum { NUM_WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t) };
+
+    std::atomic<uint64_t> m_Seq;
+    std::atomic<uint64_t> m_Words[NUM_WORDS];
+
+    SeqLock(const SeqLock&);
+    SeqLock& operator=(const SeqLock&);
+};
+
+#endif
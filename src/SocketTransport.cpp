@@ -14,9 +14,16 @@
 #include <vector>
 #include <cstring>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include <google/protobuf/io/coded_stream.h>
 
 #include "SocketTransport.h"
 
+using namespace google::protobuf::io;
+
 SocketTransport::SocketTransport(bool debug) :
    m_Debug(debug),
    m_Name("SocketTransport"),
@@ -28,14 +35,26 @@ SocketTransport::SocketTransport(bool debug) :
    m_ReadBlockSize(32768),
    m_ReadBufferSize(m_ReadBlockSize),
    m_CommunicationState(COMM_STATE_NO_CLIENT),
+   m_FramingMode(FRAMING_DELIMITED),
    m_Socket(nullptr),
    m_ConnMode(ISocket::ConnectionMode_t::CONN_MODE_CLIENT),
-   m_CmdBuffer(""),
-   m_RecvCallbackPtr(0),
-   m_CheckDoneCallbackPtr(0)
+   m_SendTimeout(1.0),
+   m_CheckDoneCallbackPtr(0),
+   m_ConnCallbackPtr(0),
+   m_TxWorker("SocketTransport TX"),
+   m_RxWorker("SocketTransport RX")
 {
     m_Log = std::shared_ptr<Logger>(new Logger(m_Name, m_Debug));
 
+    pthread_mutex_init(&m_Working_Tx, NULL);
+    pthread_cond_init(&m_TxDrained, NULL);
+    std::memset(&m_PublishStats, 0, sizeof(m_PublishStats));
+
+    m_TxStep = new Callback0<SocketTransport, bool>(this, &SocketTransport::update_tx);
+    m_RxStep = new Callback0<SocketTransport, bool>(this, &SocketTransport::update_rx);
+
+    m_SocketCallback = new Callback2<SocketTransport, bool, intptr_t, void*>(this, &SocketTransport::socketCBRoutine, 0, 0);
+
     m_ReadBuffer = new char[m_ReadBlockSize];
     std::memset(m_ReadBuffer, '\0', m_ReadBlockSize);
 }
@@ -43,6 +62,15 @@ SocketTransport::SocketTransport(bool debug) :
 SocketTransport::~SocketTransport()
 {
     delete[] m_ReadBuffer;
+    delete m_SocketCallback;
+
+    m_RxWorker.Stop();
+    m_TxWorker.Stop();
+    delete m_TxStep;
+    delete m_RxStep;
+
+    pthread_cond_destroy(&m_TxDrained);
+    pthread_mutex_destroy(&m_Working_Tx);
 }
 
 bool SocketTransport::init()
@@ -83,17 +111,37 @@ bool SocketTransport::CloseConnection()
 }
 
 
-bool SocketTransport::RegisterRecvCallback(int callbackID, ICallback* callbackPtr)
+bool SocketTransport::RegisterRecvCallback(int callbackID, RecvDelegate_t callback)
 {
-    m_RecvCallbackPtr = callbackPtr;
+    m_RecvCallback = callback;
     m_Log->LogDebug("Registered Receive callback: ", callbackID);
 
     return true;
 }
 
+bool SocketTransport::RegisterConnectionCallback(int callbackID, ICallback* callbackPtr)
+{
+    m_ConnCallbackPtr = callbackPtr;
+    m_Log->LogDebug("Registered Connection callback: ", callbackID);
+
+    return true;
+}
+
+void SocketTransport::SetFramingMode(FramingMode_t mode)
+{
+    m_FramingMode = mode;
+}
+
+void SocketTransport::SetSendTimeout(double timeout_s)
+{
+    m_SendTimeout = timeout_s;
+}
+
 bool SocketTransport::UseSocket(const std::shared_ptr<ISocket> socket)
 {
     m_Socket = socket;
+    if (m_Socket)
+        m_Socket->RegisterRecvCallback(1, m_SocketCallback);
     return true;
 }
 
@@ -115,31 +163,18 @@ bool SocketTransport::StartComm()
 
     if (!m_CommStarted)
     {
-        m_ThreadHelper[TX].method = &SocketTransport::update_tx;
-        m_ThreadHelper[RX].method = &SocketTransport::update_rx;
-        m_ThreadHelper[TX].obj = (this);
-        m_ThreadHelper[RX].obj = (this);
-
-        m_ThreadHelper[TX].Done = false;
-        m_ThreadHelper[RX].Done = false;
-        m_ThreadHelper[TX].SleepTime_us = 1000;
-        m_ThreadHelper[RX].SleepTime_us = 1000;
-
-#if 0
-        // create the TX Thread
-        if (pthread_create(&(m_ThreadHelper[TX].thread_handle), 0,
-            SocketTransport::thread_func, (void *)&m_ThreadHelper[TX]) != 0)
+        // the TX worker blocks in WaitWritable until there is work, and
+        // the RX worker in PollEvents/readLine until data arrives
+        if (!m_TxWorker.Start(m_TxStep, m_ReceiveTimeout))
         {
             m_Log->LogError("Error spawning update_tx thread");
             return false;
         }
-#endif
 
-        // create the RX Thread
-        if (pthread_create(&(m_ThreadHelper[RX].thread_handle), 0,
-            SocketTransport::thread_func, (void *)&m_ThreadHelper[RX]) != 0)
+        if (!m_RxWorker.Start(m_RxStep, 0))
         {
             m_Log->LogError("Error spawning update_rx thread");
+            m_TxWorker.Stop();
             return false;
         }
 
@@ -153,31 +188,28 @@ bool SocketTransport::StopComm()
 {
     if (m_CommStarted)
     {
-        // if receive thread is in listening mode (blocked) we have to first
-        // close the connection:
-        ISocket::ConnectionState_t connectionState;
-        m_Socket->getConnectionState(connectionState);
+        // the receive thread wakes up from PollEvents/readLine at least
+        // every m_ReceiveTimeout, so join it before closing the socket
+        m_RxWorker.Stop();
 
-        if (connectionState == ISocket::STATE_SERVER_PORT_SETUP)
+        // then the TX thread, releasing any producer held at a watermark
+        m_TxWorker.Stop();
+        pthread_mutex_lock(&m_Working_Tx);
         {
-            if (!m_Socket->CloseConnection())
-                m_Log->LogError("Error closing socket.");
-            else
-                m_Log->LogInfo("Socket closed successfully.");
-
-            m_ThreadHelper[RX].Done = true;
-            pthread_join(m_ThreadHelper[RX].thread_handle, NULL);
+            pthread_cond_broadcast(&m_TxDrained);
         }
+        pthread_mutex_unlock(&m_Working_Tx);
+
+        if (!m_Socket->CloseConnection())
+            m_Log->LogError("Error closing socket.");
         else
-        {
-            m_ThreadHelper[RX].Done = true;
-            pthread_join(m_ThreadHelper[RX].thread_handle, NULL);
+            m_Log->LogInfo("Socket closed successfully.");
 
-            if (!m_Socket->CloseConnection())
-                m_Log->LogError("Error closing comm port.");
-            else
-                m_Log->LogInfo("Comm port closed successfully.");
+        pthread_mutex_lock(&m_Working_Tx);
+        {
+            m_TxConns.clear();
         }
+        pthread_mutex_unlock(&m_Working_Tx);
 
         m_CommStarted = false;
     }
@@ -185,54 +217,480 @@ bool SocketTransport::StopComm()
     return true;
 }
 
+bool SocketTransport::TransmitData(unsigned char *data_buffer, unsigned int data_size)
+{
+    // single connection (client mode) transmit
+    return TransmitData(0, (const char*)data_buffer, data_size);
+}
+
+bool SocketTransport::TransmitData(int connID, const char *data_buffer, unsigned int data_size)
+{
+    if (data_buffer == 0)
+    {
+        m_Log->LogError("SocketTransport::TransmitData: data_buffer is 0, data_size =", data_size);
+        return false;
+    }
+
+    if (data_size == 0)
+        return true;
+
+    bool wasIdle;
+    char* out = reserveTx(connID, data_size, wasIdle);
+    if (out == NULL)
+    {
+        m_Log->LogError("SocketTransport::TransmitData - unable to queue ", data_size, " bytes for connection ", connID);
+        return false;
+    }
+
+    std::memcpy(out, data_buffer, data_size);
+    commitTx(wasIdle);
+
+    return true;
+}
+
+bool SocketTransport::TransmitFrame(int connID, const google::protobuf::MessageLite& msg)
+{
+    return transmitFrame(connID, msg, true);
+}
+
+bool SocketTransport::TryTransmitFrame(int connID, const google::protobuf::MessageLite& msg)
+{
+    return transmitFrame(connID, msg, false);
+}
+
+bool SocketTransport::transmitFrame(int connID, const google::protobuf::MessageLite& msg, bool mayWait)
+{
+    size_t msgSize;
+    size_t numBytes = frameSize(msg, msgSize);
+    if (msgSize > MAX_FRAME_SIZE)
+    {
+        m_Log->LogError("SocketTransport::TransmitFrame: message too large: ", msgSize);
+        return false;
+    }
+
+    // serialized straight into the connection's send buffer
+    bool wasIdle;
+    uint8_t* out = (uint8_t*)reserveTx(connID, numBytes, wasIdle, mayWait);
+    if (out == NULL)
+    {
+        // a backed up connection is expected to lose try-once frames
+        if (mayWait)
+            m_Log->LogError("SocketTransport::TransmitFrame - unable to queue frame for connection ", connID);
+        return false;
+    }
+
+    writeFrame(msg, msgSize, out);
+    commitTx(wasIdle);
+
+    return true;
+}
+
+bool SocketTransport::TransmitFrameParts(int connID, const struct iovec* parts, int numParts)
+{
+    size_t msgSize = 0;
+    for (int i = 0; i < numParts; i++)
+        msgSize += parts[i].iov_len;
+
+    if (msgSize > MAX_FRAME_SIZE)
+    {
+        m_Log->LogError("SocketTransport::TransmitFrameParts: message too large: ", msgSize);
+        return false;
+    }
+
+    size_t numBytes;
+    if (m_FramingMode == FRAMING_DELIMITED)
+        numBytes = CodedOutputStream::VarintSize32((uint32_t)msgSize) + msgSize;
+    else
+        numBytes = msgSize + 1;
+
+    bool wasIdle;
+    uint8_t* out = (uint8_t*)reserveTx(connID, numBytes, wasIdle);
+    if (out == NULL)
+    {
+        m_Log->LogError("SocketTransport::TransmitFrameParts - unable to queue frame for connection ", connID);
+        return false;
+    }
+
+    if (m_FramingMode == FRAMING_DELIMITED)
+        out = CodedOutputStream::WriteVarint32ToArray((uint32_t)msgSize, out);
+
+    for (int i = 0; i < numParts; i++)
+    {
+        std::memcpy(out, parts[i].iov_base, parts[i].iov_len);
+        out += parts[i].iov_len;
+    }
+
+    if (m_FramingMode == FRAMING_LINE)
+        *out = '\n';
+
+    commitTx(wasIdle);
+
+    return true;
+}
+
 //=============================================================================
-// thread_func
+// PublishFrame
 //-----------------------------------------------------------------------------
+// A connection whose socket is blocked, or that still has a conflated frame
+// or TX_LOW_WATERMARK bytes waiting, is backed up: under PUBLISH_CONFLATE
+// the frame goes into its latest slot (replacing any unsent one), which
+// flushTx moves to the send queue once everything before it is written.
 //=============================================================================
-void *SocketTransport::thread_func(void *args)
+bool SocketTransport::PublishFrame(int connID, const google::protobuf::MessageLite& msg, PublishPolicy_t policy)
 {
-    ThreadHelper* threadHelper = static_cast<ThreadHelper*> (args);
+    if (policy == PUBLISH_BLOCK)
+    {
+        bool sent = TransmitFrame(connID, msg);
+        pthread_mutex_lock(&m_Working_Tx);
+        {
+            if (sent)
+                m_PublishStats.published++;
+        }
+        pthread_mutex_unlock(&m_Working_Tx);
+        return sent;
+    }
 
-    while (!threadHelper->Done)
+    size_t msgSize;
+    size_t numBytes = frameSize(msg, msgSize);
+    if (msgSize > MAX_FRAME_SIZE)
     {
-        (threadHelper->obj->*(threadHelper->method))();
-        usleep(threadHelper->SleepTime_us);
+        m_Log->LogError("SocketTransport::PublishFrame: message too large: ", msgSize);
+        return false;
     }
 
-    pthread_exit(0);
-    return NULL;
-}
+    bool wasIdle = false;
+    bool disconnect = false;
 
-bool SocketTransport::TransmitData(unsigned char *data_buffer, unsigned int data_size)
-{
-    bool	ret_val = true;
+    pthread_mutex_lock(&m_Working_Tx);
 
-    if (data_buffer == 0)
+    std::map<int, TxConn_t>::iterator it = findTxConn(connID);
+    TxConn_t& conn = it->second;
+    if (conn.closed || m_TxWorker.IsDone())
     {
-        m_Log->LogError("SocketTransport::TransmitData: data_buffer is 0, data_size =", data_size);
+        pthread_mutex_unlock(&m_Working_Tx);
         return false;
     }
 
-    // Direct Call
-    //rc = m_Socket->writeBlock((unsigned char*)data_buffer, data_size);
+    bool backedUp = conn.blocked || !conn.latest.empty() || (conn.queuedBytes >= TX_LOW_WATERMARK);
+    if (!backedUp)
+    {
+        wasIdle = (conn.queuedBytes == 0);
+        conn.queuedBytes += numBytes;
 
-    if (ret_val == false)
+        size_t used = conn.pending.size();
+        conn.pending.resize(used + numBytes);
+        writeFrame(msg, msgSize, (uint8_t*)&conn.pending[used]);
+        m_PublishStats.published++;
+    }
+    else if (policy == PUBLISH_CONFLATE)
     {
-        m_Log->LogError("SocketTransport::TransmitData - writeBytes failed.");
+        if (!conn.latest.empty())
+        {
+            conn.conflated++;
+            m_PublishStats.conflated++;
+        }
+
+        conn.latest.resize(numBytes);
+        writeFrame(msg, msgSize, (uint8_t*)&conn.latest[0]);
+        m_PublishStats.published++;
+    }
+    else
+    {
+        conn.closed = true;
+        disconnect = true;
+        m_PublishStats.disconnected++;
+    }
+
+    pthread_mutex_unlock(&m_Working_Tx);
+
+    if (disconnect)
+    {
+        m_Log->LogWarn("Connection ", connID, " is not keeping up with published data, disconnecting");
+        m_Socket->CloseConnection(connID);
         return false;
     }
 
+    if (wasIdle)
+        m_TxWorker.Wake();
+
     return true;
 }
 
+SocketTransport::PublishStats_t SocketTransport::GetPublishStats()
+{
+    PublishStats_t stats;
+    pthread_mutex_lock(&m_Working_Tx);
+    {
+        stats = m_PublishStats;
+    }
+    pthread_mutex_unlock(&m_Working_Tx);
+    return stats;
+}
+
+size_t SocketTransport::frameSize(const google::protobuf::MessageLite& msg, size_t& msgSize)
+{
+    msgSize = msg.ByteSizeLong();
+    if (m_FramingMode == FRAMING_DELIMITED)
+        return CodedOutputStream::VarintSize32((uint32_t)msgSize) + msgSize;
+    else
+        return msgSize + 1;
+}
+
+// serializes msg, after frameSize() cached its sizes
+void SocketTransport::writeFrame(const google::protobuf::MessageLite& msg, size_t msgSize, uint8_t* out)
+{
+    if (m_FramingMode == FRAMING_DELIMITED)
+    {
+        out = CodedOutputStream::WriteVarint32ToArray((uint32_t)msgSize, out);
+        msg.SerializeWithCachedSizesToArray(out);
+    }
+    else
+    {
+        out = msg.SerializeWithCachedSizesToArray(out);
+        *out = '\n';
+    }
+}
+
+// m_Working_Tx held
+std::map<int, SocketTransport::TxConn_t>::iterator SocketTransport::findTxConn(int connID)
+{
+    std::map<int, TxConn_t>::iterator it = m_TxConns.find(connID);
+    if (it == m_TxConns.end())
+    {
+        TxConn_t fresh;
+        fresh.sendOffset = 0;
+        fresh.queuedBytes = 0;
+        fresh.blocked = false;
+        fresh.closed = false;
+        fresh.conflated = 0;
+        it = m_TxConns.insert(std::make_pair(connID, fresh)).first;
+    }
+    return it;
+}
+
+//=============================================================================
+// reserveTx
+//-----------------------------------------------------------------------------
+// Locks m_Working_Tx and returns room for numBytes at the end of connID's
+// pending buffer (any thread).  Blocks while the connection is above
+// TX_HIGH_WATERMARK, for up to m_SendTimeout, unless mayWait is false, in
+// which case it gives up right away.  On success the caller fills
+// the room in and calls commitTx(); NULL means the data has to be dropped
+// and the lock is not held.
+//=============================================================================
+char* SocketTransport::reserveTx(int connID, size_t numBytes, bool& wasIdle, bool mayWait)
+{
+    pthread_mutex_lock(&m_Working_Tx);
+
+    std::map<int, TxConn_t>::iterator it = findTxConn(connID);
+
+    if ((it->second.queuedBytes >= TX_HIGH_WATERMARK) && m_CommStarted && !mayWait)
+    {
+        it = m_TxConns.end();
+    }
+    else if ((it->second.queuedBytes >= TX_HIGH_WATERMARK) && m_CommStarted)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long nsec = deadline.tv_nsec + (long long)(m_SendTimeout * 1e9);
+        deadline.tv_sec += nsec / 1000000000LL;
+        deadline.tv_nsec = nsec % 1000000000LL;
+
+        while ((it != m_TxConns.end()) && !it->second.closed &&
+               (it->second.queuedBytes > TX_LOW_WATERMARK) && !m_TxWorker.IsDone())
+        {
+            if (pthread_cond_timedwait(&m_TxDrained, &m_Working_Tx, &deadline) == ETIMEDOUT)
+                break;
+            it = m_TxConns.find(connID);
+        }
+
+        if ((it != m_TxConns.end()) && !it->second.closed && !m_TxWorker.IsDone() &&
+            (it->second.queuedBytes > TX_LOW_WATERMARK))
+        {
+            m_Log->LogWarn("Connection ", connID, " is not draining (", it->second.queuedBytes,
+                           " bytes queued), dropping ", numBytes, " bytes");
+            it = m_TxConns.end();
+        }
+    }
+
+    if ((it == m_TxConns.end()) || it->second.closed || m_TxWorker.IsDone())
+    {
+        pthread_mutex_unlock(&m_Working_Tx);
+        return NULL;
+    }
+
+    TxConn_t& conn = it->second;
+    wasIdle = (conn.queuedBytes == 0);
+    conn.queuedBytes += numBytes;
+
+    // keeps its capacity across flushes, so this only allocates while the
+    // buffer is still growing to the connection's working size
+    size_t used = conn.pending.size();
+    conn.pending.resize(used + numBytes);
+    return &conn.pending[used];
+}
+
+void SocketTransport::commitTx(bool wasIdle)
+{
+    pthread_mutex_unlock(&m_Working_Tx);
+
+    if (wasIdle)
+        m_TxWorker.Wake();
+}
+
+//=============================================================================
+// flushTx
+//-----------------------------------------------------------------------------
+// One write per connection with queued bytes.  Each connection has two
+// buffers: producers append to pending, while this thread writes sending
+// outside of m_Working_Tx (only this thread touches sending, or erases
+// connections).  Once sending is drained the two are swapped, so every
+// frame queued in the meantime goes out in a single write, and both keep
+// their capacity.  Returns true if some connection has more to send.
+//=============================================================================
+bool SocketTransport::flushTx()
+{
+    m_TxWrites.clear();
+
+    pthread_mutex_lock(&m_Working_Tx);
+    {
+        std::map<int, TxConn_t>::iterator it = m_TxConns.begin();
+        while (it != m_TxConns.end())
+        {
+            TxConn_t& conn = it->second;
+            if (conn.closed)
+            {
+                if (conn.conflated > 0)
+                    m_Log->LogInfo("Connection ", it->first, " closed, ", conn.conflated, " published frames were conflated");
+                it = m_TxConns.erase(it);
+                pthread_cond_broadcast(&m_TxDrained);
+                continue;
+            }
+
+            if (!conn.blocked)
+            {
+                // everything ahead of the conflated frame is written
+                if ((conn.sendOffset == conn.sending.size()) && conn.pending.empty() && !conn.latest.empty())
+                {
+                    conn.pending.swap(conn.latest);
+                    conn.latest.clear();
+                    conn.queuedBytes += conn.pending.size();
+                }
+
+                if ((conn.sendOffset == conn.sending.size()) && !conn.pending.empty())
+                {
+                    conn.sending.swap(conn.pending);
+                    conn.pending.clear();
+                    conn.sendOffset = 0;
+                }
+
+                if (conn.sendOffset < conn.sending.size())
+                {
+                    TxWrite_t write;
+                    write.connID = it->first;
+                    write.conn = &conn;
+                    write.iov.iov_base = (void*)(conn.sending.data() + conn.sendOffset);
+                    write.iov.iov_len = conn.sending.size() - conn.sendOffset;
+                    write.written = 0;
+                    m_TxWrites.push_back(write);
+                }
+            }
+            ++it;
+        }
+    }
+    pthread_mutex_unlock(&m_Working_Tx);
+
+    for (size_t i = 0; i < m_TxWrites.size(); i++)
+        m_TxWrites[i].written = m_Socket->writeData(m_TxWrites[i].connID, &m_TxWrites[i].iov, 1);
+
+    bool moreReady = false;
+
+    pthread_mutex_lock(&m_Working_Tx);
+    {
+        for (size_t i = 0; i < m_TxWrites.size(); i++)
+        {
+            TxConn_t& conn = *m_TxWrites[i].conn;
+            if (m_TxWrites[i].written < 0)
+            {
+                LOG_DEBUG(m_Log, "Dropping ", conn.queuedBytes, " queued bytes for closed connection ", m_TxWrites[i].connID);
+                conn.closed = true;
+                continue;
+            }
+
+            conn.sendOffset += m_TxWrites[i].written;
+            conn.queuedBytes -= m_TxWrites[i].written;
+
+            if (conn.sendOffset < conn.sending.size())
+            {
+                conn.blocked = true;
+            }
+            else
+            {
+                conn.sendOffset = 0;
+                conn.sending.clear();
+                // do not hang on to the memory of a one-off burst
+                if (conn.sending.capacity() > TX_LOW_WATERMARK)
+                    std::string().swap(conn.sending);
+
+                if (!conn.pending.empty() || !conn.latest.empty())
+                    moreReady = true;
+            }
+
+            if (conn.queuedBytes <= TX_LOW_WATERMARK)
+                pthread_cond_broadcast(&m_TxDrained);
+        }
+    }
+    pthread_mutex_unlock(&m_Working_Tx);
+
+    return moreReady;
+}
+
 //=============================================================================
 // update_tx_routine
 //-----------------------------------------------------------------------------
 //=============================================================================
 bool SocketTransport::update_tx()
 {
-    // until we decide to use this thread or not, just sleep a bit...
-    usleep(1000*1000);
+    // consume the wake ups first, anything queued after this wakes the wait
+    m_TxWorker.ResetWake();
+
+    bool moreReady = flushTx();
+
+    std::vector<int>& blocked = m_TxBlocked;
+    blocked.clear();
+    pthread_mutex_lock(&m_Working_Tx);
+    {
+        for (std::map<int, TxConn_t>::iterator it = m_TxConns.begin(); it != m_TxConns.end(); ++it)
+        {
+            if (it->second.blocked && !it->second.closed)
+                blocked.push_back(it->first);
+        }
+    }
+    pthread_mutex_unlock(&m_Working_Tx);
+
+    // without a TX thread (doWork) this must not block
+    double timeout = moreReady ? 0 : (m_CommStarted ? m_ReceiveTimeout : 0);
+    // returning idle lets the worker's wait (up to m_ReceiveTimeout) pace
+    // the retry
+    if (!m_Socket->WaitWritable(blocked, m_TxWorker.GetWakeFd(), timeout))
+    {
+        m_Log->LogError("Error waiting for socket to become writable: ", m_Socket->GetName());
+        return false;
+    }
+
+    if (!blocked.empty())
+    {
+        pthread_mutex_lock(&m_Working_Tx);
+        {
+            for (size_t i = 0; i < blocked.size(); i++)
+            {
+                std::map<int, TxConn_t>::iterator it = m_TxConns.find(blocked[i]);
+                if (it != m_TxConns.end())
+                    it->second.blocked = false;
+            }
+        }
+        pthread_mutex_unlock(&m_Working_Tx);
+    }
 
     return true;
 }
@@ -245,8 +703,6 @@ bool SocketTransport::update_rx()
 {
     bool ret_val;
     int numRead = 0;
-    std::vector<std::string> cmdStrs;
-    std::string client_IP;
 
     ISocket::ConnectionState_t connectionState;
     ret_val = m_Socket->getConnectionState(connectionState);
@@ -269,21 +725,15 @@ bool SocketTransport::update_rx()
             }
             break;
 
-        case ISocket::STATE_SERVER_PORT_SETUP:
-            ret_val = m_Socket->ListenForClient(client_IP);
+        case ISocket::STATE_SERVER_LISTENING:
+            // reactor mode: connections are handed to socketCBRoutine
+            ret_val = m_Socket->PollEvents(m_ReceiveTimeout);
             if (ret_val == false)
             {
+                m_Log->LogError("Error polling socket: ", m_Socket->GetName());
+                usleep(500 * 1000);
                 return false;
             }
-
-            m_Socket->getConnectionState(connectionState);
-            if (ISocket::ConnectionState_t::STATE_CONNECTED == connectionState)
-                m_Log->LogDebug("Client connected from: ", client_IP);
-            break;
-
-        case ISocket::STATE_SERVER_LISTENING:
-            m_Log->LogDebug("ISocket::STATE_SERVER_LISTENING");
-            // not doing anything for this just yet...
             break;
 
         case ISocket::STATE_CONNECTED:
@@ -336,33 +786,7 @@ bool SocketTransport::update_rx()
 
             if (numRead > 0)
             {
-               //m_Log->LogDebug("...numRead = ", numRead, ": ", m_ReadBuffer);
-
-                m_CmdBuffer.append(m_ReadBuffer);
-                std::memset(m_ReadBuffer, '\0', m_ReadBlockSize);
-
-                std::string::size_type idx = m_CmdBuffer.find('\n');
-                while (idx != std::string::npos)
-                {
-                    cmdStrs.push_back(m_CmdBuffer.substr(0, idx));
-                    m_CmdBuffer = m_CmdBuffer.substr(idx + 1);
-                    idx = m_CmdBuffer.find('\n');
-                }
-
-                for (std::string cmdStr : cmdStrs)
-                {
-                   if (m_RecvCallbackPtr)
-                   {
-                      //m_RecvCallbackPtr->Invoke((void *)numRead, (void *)cmdStr.c_str());
-                      //m_Log->LogDebug("...Sending to callback: ", cmdStr);
-                      m_RecvCallbackPtr->Invoke((void *)++m_Invoke_Cnt, &cmdStr);
-                   }
-                   else
-                   {
-                       // no callback so just print to console...
-                       m_Log->LogDebug("Rcvd: ", cmdStr);
-                   }
-                }
+                processRecvData(0, m_ReadBuffer, numRead);
             }
             //else
             //    m_Log->LogDebug("No data...");
@@ -378,3 +802,193 @@ bool SocketTransport::update_rx()
 
     return true;
 }
+
+//=============================================================================
+// socketCBRoutine
+//-----------------------------------------------------------------------------
+// Called from PollEvents (on the RX thread) for every connection event.
+//=============================================================================
+bool SocketTransport::socketCBRoutine(intptr_t connID, void* recvEvent)
+{
+    ISocket::RecvEvent_t &event = *static_cast<ISocket::RecvEvent_t*>(recvEvent);
+
+    switch (event.event)
+    {
+        case ISocket::EVENT_CONNECTED:
+            m_Log->LogDebug("Client connected from: ", event.peer, " (connection ", connID, ")");
+            m_CmdBuffers.erase(connID);
+            break;
+
+        case ISocket::EVENT_DATA:
+            processRecvData(connID, event.data, event.numBytes);
+            break;
+
+        case ISocket::EVENT_DISCONNECTED:
+            m_Log->LogDebug("Client disconnected: ", event.peer, " (connection ", connID, ")");
+            m_CmdBuffers.erase(connID);
+
+            // let the TX thread discard whatever is still queued for it
+            pthread_mutex_lock(&m_Working_Tx);
+            {
+                std::map<int, TxConn_t>::iterator it = m_TxConns.find(connID);
+                if (it != m_TxConns.end())
+                {
+                    it->second.closed = true;
+                    pthread_cond_broadcast(&m_TxDrained);
+                }
+            }
+            pthread_mutex_unlock(&m_Working_Tx);
+            m_TxWorker.Wake();
+            break;
+    }
+
+    if ((event.event != ISocket::EVENT_DATA) && m_ConnCallbackPtr)
+        m_ConnCallbackPtr->Invoke((void *)connID, &event.event);
+
+    return true;
+}
+
+//=============================================================================
+// processRecvData
+//-----------------------------------------------------------------------------
+// Hands every complete frame to the receive callback, with the connection ID
+// as the reply ID.  Frames are parsed straight out of the socket's receive
+// buffer; only a trailing partial frame is copied into the connection's
+// ring buffer, to be completed (and parsed in place) by the next reads.
+//=============================================================================
+void SocketTransport::processRecvData(int connID, const char* data, int numBytes)
+{
+    std::shared_ptr<RingBuffer> &ring = m_CmdBuffers[connID];
+    size_t remaining = numBytes;
+
+    if ((ring == nullptr) || ring->empty())
+    {
+        size_t consumed = splitFrames(connID, data, remaining);
+        data += consumed;
+        remaining -= consumed;
+        if (remaining == 0)
+            return;
+    }
+
+    if (ring == nullptr)
+    {
+        ring = std::shared_ptr<RingBuffer>(new RingBuffer());
+        if (!ring->init(RECV_RING_SIZE))
+        {
+            m_Log->LogError("Unable to allocate receive buffer for connection ", connID, ", closing it");
+            m_Socket->CloseConnection(connID);
+            ring = nullptr;
+            return;
+        }
+    }
+
+    while (remaining > 0)
+    {
+        if (ring->freeSpace() == 0)
+        {
+            // the ring is full of one unfinished frame.  A delimited frame's
+            // size was checked against MAX_FRAME_SIZE from its header; a
+            // line has no header, so it is rejected once it gets that long
+            if ((m_FramingMode == FRAMING_LINE) && (ring->size() >= MAX_FRAME_SIZE))
+            {
+                m_Log->LogError("Line of more than ", MAX_FRAME_SIZE, " bytes on connection ", connID, " exceeds limit, closing it");
+                m_Socket->CloseConnection(connID);
+                ring->consume(ring->size());
+                return;
+            }
+
+            if (!ring->grow(ring->capacity() * 2))
+            {
+                m_Log->LogError("Unable to grow receive buffer for connection ", connID, ", closing it");
+                m_Socket->CloseConnection(connID);
+                ring->consume(ring->size());
+                return;
+            }
+        }
+
+        size_t written = ring->write(data, remaining);
+        data += written;
+        remaining -= written;
+
+        ring->consume(splitFrames(connID, ring->readPtr(), ring->size()));
+    }
+}
+
+size_t SocketTransport::splitFrames(int connID, const char* data, size_t numBytes)
+{
+    if (m_FramingMode == FRAMING_DELIMITED)
+        return splitDelimited(connID, data, numBytes);
+    else
+        return splitLines(connID, data, numBytes);
+}
+
+size_t SocketTransport::splitLines(int connID, const char* data, size_t numBytes)
+{
+    size_t consumed = 0;
+
+    while (consumed < numBytes)
+    {
+        const char* eol = (const char*)memchr(data + consumed, '\n', numBytes - consumed);
+        if (eol == NULL)
+            break;
+
+        dispatchFrame(connID, data + consumed, (int)(eol - (data + consumed)));
+        consumed = (eol - data) + 1;
+    }
+
+    return consumed;
+}
+
+size_t SocketTransport::splitDelimited(int connID, const char* data, size_t numBytes)
+{
+    size_t consumed = 0;
+
+    while (consumed < numBytes)
+    {
+        size_t avail = numBytes - consumed;
+        CodedInputStream coded_input((const uint8_t*)data + consumed, (int)avail);
+
+        google::protobuf::uint32 size;
+        if (!coded_input.ReadVarint32(&size))
+        {
+            if (avail >= 5)
+            {
+                // a varint32 is at most 5 bytes, so this is garbage
+                m_Log->LogError("Malformed frame header on connection ", connID, ", closing it");
+                m_Socket->CloseConnection(connID);
+                return numBytes;
+            }
+            break;
+        }
+
+        if (size > MAX_FRAME_SIZE)
+        {
+            m_Log->LogError("Frame of ", size, " bytes on connection ", connID, " exceeds limit, closing it");
+            m_Socket->CloseConnection(connID);
+            return numBytes;
+        }
+
+        size_t hdrSize = coded_input.CurrentPosition();
+        if (avail - hdrSize < size)
+            break;
+
+        dispatchFrame(connID, data + consumed + hdrSize, (int)size);
+        consumed += hdrSize + size;
+    }
+
+    return consumed;
+}
+
+void SocketTransport::dispatchFrame(int connID, const char* data, int numBytes)
+{
+    ++m_Invoke_Cnt;
+    if (m_RecvCallback)
+    {
+        m_RecvCallback(connID, data, numBytes);
+    }
+    else
+    {
+        // no callback so just print to console...
+        LOG_DEBUG(m_Log, "Rcvd ", numBytes, " byte frame on connection ", connID);
+    }
+}
@@ -15,16 +15,35 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <map>
+
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include <google/protobuf/message_lite.h>
 
 #include "Logger.h"
 #include "ISocket.h"
 #include "Callback.h"
-
-#define TX	0
-#define RX 	1
+#include "Delegate.h"
+#include "RingBuffer.h"
+#include "WorkerThread.h"
 
 #define MAX_STRING_SIZE 128
 
+// Largest frame accepted in FRAMING_DELIMITED mode
+#define MAX_FRAME_SIZE  (16 * 1024 * 1024)
+
+// Initial per-connection receive accumulator size; only grows for a single
+// frame that does not fit
+#define RECV_RING_SIZE  65536
+
+// Per-connection send queue watermarks: producers block once a connection
+// has TX_HIGH_WATERMARK bytes queued, until the TX thread drains it below
+// TX_LOW_WATERMARK (or the send timeout expires and the frame is dropped)
+#define TX_HIGH_WATERMARK  (1024 * 1024)
+#define TX_LOW_WATERMARK   (256 * 1024)
+
 //=============================================================================
 // CLASS: Socket Transport Interface Class
 //-----------------------------------------------------------------------------
@@ -44,6 +63,40 @@ public:
         SOCKET_READ_MODE_UNTIL
     };
 
+    /* How commands are delimited on the wire */
+    enum FramingMode_t
+    {
+        FRAMING_LINE = 0,       // terminated by '\n' (text only)
+        FRAMING_DELIMITED       // varint length prefix, then the message
+    };
+
+    /*
+     * Receive callback, invoked on the RX thread with the connection ID and
+     * a complete frame.  The data points straight into the receive buffer,
+     * so it is only valid during the callback.
+     */
+    typedef Delegate<bool(int connID, const char* data, int numBytes)> RecvDelegate_t;
+
+    /*
+     * What PublishFrame does with a frame for a connection that is not
+     * keeping up (still holding earlier frames in its send queue).  The
+     * socket decides when that is: epoll once the kernel send buffer is
+     * full, io_uring once URING_SEND_LIMIT bytes are queued on the ring.
+     */
+    enum PublishPolicy_t
+    {
+        PUBLISH_CONFLATE = 0,   // newest frame replaces the unsent older one
+        PUBLISH_BLOCK,          // queue it like TransmitFrame, waiting at the high watermark
+        PUBLISH_DISCONNECT      // drop the connection
+    };
+
+    struct PublishStats_t
+    {
+        unsigned long long published;
+        unsigned long long conflated;       // replaced before being sent
+        unsigned long long disconnected;    // connections dropped for falling behind
+    };
+
              SocketTransport(bool debug = false);
     virtual ~SocketTransport();
 
@@ -59,32 +112,48 @@ public:
 
     // TransmitData: Returns TRUE is data is successfully submitted for transport.
     //               Returns FALSE if it fails.
+    //               Data is queued for the TX thread; the call only blocks
+    //               while connID is above its high watermark.
     virtual bool TransmitData(unsigned char *data_buffer, unsigned int data_size);
+    virtual bool TransmitData(int connID, const char *data_buffer, unsigned int data_size);
+
+    // TransmitFrame: frames msg according to the framing mode and sends it
+    //                on connection connID.
+    virtual bool TransmitFrame(int connID, const google::protobuf::MessageLite& msg);
+
+    // TryTransmitFrame: like TransmitFrame, but never waits; a connection
+    //                   above its high watermark loses the frame (FALSE).
+    //                   For the RX thread, which must not stall the others.
+    virtual bool TryTransmitFrame(int connID, const google::protobuf::MessageLite& msg);
+
+    // TransmitFrameParts: frames the concatenation of numParts already
+    //                     serialized pieces of one message (a prebuilt body
+    //                     plus per-reply fields) without reserializing it.
+    virtual bool TransmitFrameParts(int connID, const struct iovec* parts, int numParts);
+
+    // PublishFrame: like TransmitFrame for latest-value data (pushed
+    //               results); a slow connection gets one conflating slot
+    //               instead of a backlog.  Only PUBLISH_BLOCK can wait.
+    //               Returns FALSE if the connection is gone or was dropped.
+    virtual bool PublishFrame(int connID, const google::protobuf::MessageLite& msg, PublishPolicy_t policy);
+    PublishStats_t GetPublishStats();
+
+    void SetFramingMode(FramingMode_t mode);
+    void SetSendTimeout(double timeout_s);
 
     bool StartComm();
     bool StopComm();
 
-    virtual bool RegisterRecvCallback(int callbackID, ICallback* callbackPtr);
+    virtual bool RegisterRecvCallback(int callbackID, RecvDelegate_t callback);
 
-    //virtual bool TransmitFrame(unsigned char *data_frame, unsigned int data_size);
+    // Invoked with the connection ID and an ISocket::ConnectionEvent_t*
+    // when a client connects or disconnects (RX thread)
+    virtual bool RegisterConnectionCallback(int callbackID, ICallback* callbackPtr);
 
     //--------------------------------------------------------------------------
     // PROTECTED
     //--------------------------------------------------------------------------
 protected:
-    struct ThreadHelper
-    {
-        pthread_t		thread_handle;
-        pthread_attr_t	thread_attrib;
-
-        SocketTransport	*obj;
-        bool 	(SocketTransport::*method)(void);
-
-        bool	Done;
-        int    SleepTime_us;
-    };
-
-
     bool m_Debug;
     std::string m_Name;
     std::shared_ptr<Logger> m_Log;
@@ -103,24 +172,80 @@ protected:
     char*	          m_ReadBuffer;
     unsigned int	    m_ReadBufferSize;
     CommState_t		 m_CommunicationState;
+    FramingMode_t      m_FramingMode;
 
     //char m_LastErrorString[MAX_STRING_SIZE];
 
     std::shared_ptr<ISocket> m_Socket;
     ISocket::ConnectionMode_t m_ConnMode;
 
-    std::string m_CmdBuffer;
+    // partially received frames, keyed by connection ID
+    std::map<int, std::shared_ptr<RingBuffer> > m_CmdBuffers;
+
+    // outgoing bytes of one connection, see flushTx
+    struct TxConn_t
+    {
+        std::string pending;    // appended to by producers
+        std::string sending;    // being written by the TX thread
+        size_t sendOffset;      // bytes of sending already written
+        size_t queuedBytes;
+        bool   blocked;         // short write, waiting to become writable
+        bool   closed;
+        std::string latest;     // newest published frame, held while backed up
+        unsigned long long conflated;
+    };
+
+    struct TxWrite_t
+    {
+        int          connID;
+        TxConn_t*    conn;
+        struct iovec iov;
+        int          written;
+    };
+
+    std::map<int, TxConn_t> m_TxConns;
+    pthread_mutex_t m_Working_Tx;
+    pthread_cond_t  m_TxDrained;
+    double          m_SendTimeout;
+    PublishStats_t  m_PublishStats;
+
+    // TX thread scratch, kept to avoid allocating on every pass
+    std::vector<TxWrite_t> m_TxWrites;
+    std::vector<int>       m_TxBlocked;
 
     //void *m_TransmitQueue;
     //void *m_ReceiveQueue;
     //void *m_CallbackList;
 
-    ICallback* m_RecvCallbackPtr;
+    RecvDelegate_t m_RecvCallback;
     ICallback* m_CheckDoneCallbackPtr;
-
-    ThreadHelper      m_ThreadHelper[2];
-    // STATIC 
-    static void *thread_func(void *args);
+    ICallback* m_ConnCallbackPtr;
+
+    // receives the socket's per-connection RecvEvent_t's
+    Callback2<SocketTransport, bool, intptr_t, void* >* m_SocketCallback;
+    bool socketCBRoutine(intptr_t connID, void* recvEvent);
+
+    void processRecvData(int connID, const char* data, int numBytes);
+    size_t splitFrames(int connID, const char* data, size_t numBytes);
+    size_t splitLines(int connID, const char* data, size_t numBytes);
+    size_t splitDelimited(int connID, const char* data, size_t numBytes);
+    void dispatchFrame(int connID, const char* data, int numBytes);
+
+    size_t frameSize(const google::protobuf::MessageLite& msg, size_t& msgSize);
+    void writeFrame(const google::protobuf::MessageLite& msg, size_t msgSize, uint8_t* out);
+
+    std::map<int, TxConn_t>::iterator findTxConn(int connID);
+    bool transmitFrame(int connID, const google::protobuf::MessageLite& msg, bool mayWait);
+    char* reserveTx(int connID, size_t numBytes, bool& wasIdle, bool mayWait = true);
+    void commitTx(bool wasIdle);
+    bool flushTx();
+
+    // the TX worker sleeps on its wake fd (with the blocked sockets) until
+    // a producer queues a frame; the RX worker blocks in the socket
+    WorkerThread m_TxWorker;
+    WorkerThread m_RxWorker;
+    Callback0<SocketTransport, bool>* m_TxStep;
+    Callback0<SocketTransport, bool>* m_RxStep;
 
     virtual bool update_tx();
     virtual bool update_rx();
@@ -0,0 +1,131 @@
+/**************************************************************************
+*
+*		     Source:  WorkerThread.cpp
+*           Project:  ScorpionServer
+*
+*            Author: trafferty
+*              Date: Oct 17, 2026
+*
+*		Description:
+*			> Event driven worker thread, see WorkerThread.h
+*
+****************************************************************************/
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "WorkerThread.h"
+
+WorkerThread::WorkerThread(const std::string& name) :
+   m_Name(name),
+   m_WakeFd(-1),
+   m_Step(0),
+   m_IdleTimeout(-1.0),
+   m_Running(false),
+   m_Done(false)
+{
+    // created up front so Wake() is valid even before Start()
+    m_WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+WorkerThread::~WorkerThread()
+{
+    Stop();
+
+    if (m_WakeFd != -1)
+        close(m_WakeFd);
+}
+
+bool WorkerThread::Start(ICallback* step, double idleTimeout_s)
+{
+    if (m_Running || (step == 0) || (m_WakeFd == -1))
+        return false;
+
+    m_Step = step;
+    m_IdleTimeout = idleTimeout_s;
+    m_Done = false;
+
+    if (pthread_create(&m_Thread, 0, WorkerThread::thread_func, (void *)this) != 0)
+        return false;
+
+    m_Running = true;
+    return true;
+}
+
+void WorkerThread::Stop()
+{
+    if (!m_Running)
+        return;
+
+    m_Done = true;
+    Wake();
+    pthread_join(m_Thread, NULL);
+
+    m_Running = false;
+}
+
+void WorkerThread::Wake()
+{
+    uint64_t one = 1;
+    if (m_WakeFd != -1)
+    {
+        // a saturated counter still wakes the reader, so the result is irrelevant
+        ssize_t ignored __attribute__((unused)) = write(m_WakeFd, &one, sizeof(one));
+    }
+}
+
+void WorkerThread::ResetWake()
+{
+    uint64_t count;
+    if (m_WakeFd != -1)
+    {
+        ssize_t ignored __attribute__((unused)) = read(m_WakeFd, &count, sizeof(count));
+    }
+}
+
+//=============================================================================
+// Wait
+//-----------------------------------------------------------------------------
+// Blocks until Wake() or timeout_s (negative: no timeout), consuming the
+// wake up.  Returns false once the worker has been told to stop.
+//=============================================================================
+bool WorkerThread::Wait(double timeout_s)
+{
+    if (m_Done)
+        return false;
+
+    struct pollfd pfd;
+    pfd.fd = m_WakeFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int timeout_ms = (timeout_s < 0) ? -1 : (int)(timeout_s * 1000);
+    if ((poll(&pfd, 1, timeout_ms) > 0) && (pfd.revents & POLLIN))
+        ResetWake();
+
+    return !m_Done;
+}
+
+//=============================================================================
+// thread_func
+//-----------------------------------------------------------------------------
+//=============================================================================
+void *WorkerThread::thread_func(void *args)
+{
+    WorkerThread* worker = static_cast<WorkerThread*> (args);
+
+    while (!worker->m_Done)
+    {
+        worker->m_Step->Invoke();
+        bool busy = (worker->m_Step->GetReturnValue() != 0);
+
+        if (!busy)
+            worker->Wait(worker->m_IdleTimeout);
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
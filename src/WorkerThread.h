@@ -0,0 +1,65 @@
+/**************************************************************************
+*
+*		     Source:  WorkerThread.h
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > A thread that repeatedly runs one step callback.  A step
+*		    returns true when it did some work (run it again right away)
+*		    or false when it is idle, in which case the thread sleeps on
+*		    an eventfd until Wake() is called or the idle timeout runs
+*		    out.  Steps that block on their own (poll, epoll) can wait
+*		    on GetWakeFd() along with their other descriptors.
+*
+****************************************************************************/
+#ifndef __WORKER_THREAD_H__
+#define __WORKER_THREAD_H__
+
+#include <string>
+#include <atomic>
+
+#include <pthread.h>
+
+#include "Callback.h"
+
+class WorkerThread
+{
+public:
+             WorkerThread(const std::string& name);
+    virtual ~WorkerThread();
+
+    // step is an ICallback returning bool (e.g. Callback0<T,bool>); a
+    // negative idleTimeout_s sleeps until woken
+    bool Start(ICallback* step, double idleTimeout_s = -1.0);
+    void Stop();
+
+    void Wake();
+    bool Wait(double timeout_s);
+
+    int  GetWakeFd() const { return m_WakeFd; }
+    void ResetWake();
+
+    bool IsRunning() const { return m_Running; }
+    bool IsDone() const    { return m_Done; }
+
+    std::string GetName() const { return m_Name; }
+
+private:
+    std::string       m_Name;
+    pthread_t         m_Thread;
+    int               m_WakeFd;
+    ICallback*        m_Step;
+    double            m_IdleTimeout;
+    bool              m_Running;
+    std::atomic<bool> m_Done;
+
+    WorkerThread(const WorkerThread&);
+    WorkerThread& operator=(const WorkerThread&);
+
+    static void *thread_func(void *args);
+};
+
+#endif
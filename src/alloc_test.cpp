@@ -0,0 +1,208 @@
+// Heap allocation test for the steady-state request path.
+//
+//   alloc_test [method] [queries] [port]
+//
+// Runs a CommandProcessor in process, warms a connection up with
+// <queries> commands of <method> (default query), then counts every
+// operator new in the process (all threads) while the same connection
+// sends <queries> more, one at a time.  The client side uses prebuilt
+// frames and a fixed receive buffer, so whatever is counted is the
+// server's.  Exits 0 if the measured loop made no allocation at all.
+
+// local:
+#include "Logger.h"
+#include "CommandProcessor.h"
+#include "CNT_JSON.h"
+#include "payload.pb.h"
+
+// from system:
+#include <new>
+#include <string>
+#include <memory>
+#include <atomic>
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+static std::atomic<unsigned long long> s_Allocations(0);
+
+void* operator new(size_t size)
+{
+   s_Allocations.fetch_add(1, std::memory_order_relaxed);
+   void* p = malloc(size ? size : 1);
+   if (p == NULL)
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+   s_Allocations.fetch_add(1, std::memory_order_relaxed);
+   return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+   return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+   free(p);
+}
+
+static void putVarint(std::string& out, uint32_t value)
+{
+   while (value >= 0x80)
+   {
+      out += (char)((value & 0x7f) | 0x80);
+      value >>= 7;
+   }
+   out += (char)value;
+}
+
+// sends one frame and reads its reply; no allocation on this side
+static bool roundTrip(int sock, const std::string& frame, char* buffer, size_t bufferSize)
+{
+   if (send(sock, frame.data(), frame.size(), MSG_NOSIGNAL) != (ssize_t)frame.size())
+      return false;
+
+   size_t got = 0;
+   size_t need = 0;
+   for (;;)
+   {
+      ssize_t n = recv(sock, buffer + got, bufferSize - got, 0);
+      if (n <= 0)
+         return false;
+      got += n;
+
+      if (need == 0)
+      {
+         uint32_t size = 0;
+         size_t i = 0;
+         for (int shift = 0; (i < got) && (shift < 35); shift += 7, i++)
+         {
+            size |= (uint32_t)(buffer[i] & 0x7f) << shift;
+            if ((buffer[i] & 0x80) == 0)
+            {
+               need = i + 1 + size;
+               break;
+            }
+         }
+      }
+
+      if ((need > 0) && (got >= need))
+         return true;
+      if (got == bufferSize)
+         return false;
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("AllocTest", false));
+
+   string method = (argc > 1) ? argv[1] : "query";
+   int queries   = (argc > 2) ? std::stoi(argv[2]) : 10000;
+   int port      = (argc > 3) ? std::stoi(argv[3]) : 12072;
+
+   if (queries <= 0)
+   {
+      m_Log->LogError("usage: alloc_test [method] [queries] [port]");
+      return 1;
+   }
+
+   string configText = "{\"ipAddress\":\"127.0.0.1\",\"port\":" + std::to_string(port) +
+                       ",\"exit_on_quit\":false,\"imgEngine\":{\"imgEng_type\":\"fake\"}}";
+   cJSON* config = cJSON_Parse(configText.c_str());
+
+   std::shared_ptr<CommandProcessor> cmd = std::shared_ptr<CommandProcessor>(new CommandProcessor(false));
+   if ((config == NULL) || !cmd->init(config) || !cmd->Start())
+   {
+      m_Log->LogError("Command Processor initialization failed");
+      return 1;
+   }
+
+   int sock = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+   int yes = 1;
+   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+   bool connected = false;
+   for (int i = 0; (i < 100) && !connected; i++)
+   {
+      connected = (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+      if (!connected)
+         usleep(10000);
+   }
+
+   sandbox::Command command;
+   command.set_method(method);
+   command.set_id(1);
+   string body = command.SerializeAsString();
+   string frame;
+   putVarint(frame, body.size());
+   frame += body;
+
+   static char replyBuffer[65536];
+   bool ok = connected;
+
+   for (int i = 0; ok && (i < queries); i++)
+      ok = roundTrip(sock, frame, replyBuffer, sizeof(replyBuffer));
+
+   unsigned long long before = s_Allocations.load();
+   for (int i = 0; ok && (i < queries); i++)
+      ok = roundTrip(sock, frame, replyBuffer, sizeof(replyBuffer));
+   unsigned long long allocations = s_Allocations.load() - before;
+
+   close(sock);
+   cmd->Shutdown();
+   cJSON_Delete(config);
+
+   if (!ok)
+   {
+      m_Log->LogError("FAILED: lost the connection to the command processor");
+      return 1;
+   }
+
+   m_Log->LogInfo(method, ": ", allocations, " heap allocation(s) in ", queries, " steady-state commands");
+   if (allocations > 0)
+   {
+      m_Log->LogError("FAILED: ", (double)allocations / queries, " allocations per command");
+      return 1;
+   }
+
+   m_Log->LogInfo("OK: no heap allocation per steady-state command");
+   return 0;
+}
@@ -4,6 +4,7 @@
 #include "ISocket.h"
 #include "LinuxSocket.h"
 #include "SocketTransport.h"
+#include "AsyncClient.h"
 #include "payload.pb.h"
 
 // from common:
@@ -13,15 +14,21 @@
 // from system:
 #include <sstream>
 #include <memory>
+#include <deque>
 #include <stdio.h>
 #include <iomanip>
 #include <signal.h>
 
 #include <cstring>
+#include <chrono>
 #include <unistd.h>
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
 
 using namespace std;
+using namespace google::protobuf::io;
 
 bool CtrlC = false;
 void sigint_handler(int n)
@@ -30,43 +37,112 @@ void sigint_handler(int n)
     std::cerr << "sigint received - aborting: " << n << std::endl;
 }
 
-std::string readLineFromSocket(std::shared_ptr<ISocket> socket)
+// Queries per CommandBatch in batch mode (plus one status)
+#define CLIENT_BATCH_QUERIES  8
+
+// Queries kept in flight in pipeline mode
+#define CLIENT_PIPELINE_DEPTH  32
+
+// Pipeline mode: a query waiting this many results ahead (0.5 s), sent once
+// a second to show it completing behind the fast ones sent after it
+#define CLIENT_LONG_POLL_AHEAD  50
+
+class LongPoll
+{
+public:
+   LongPoll(std::shared_ptr<Logger> log) : m_Log(log), m_Waiting(false), m_FastDone(0) {}
+
+   std::shared_ptr<Logger> m_Log;
+   std::atomic<bool> m_Waiting;
+   std::atomic<long long> m_FastDone;   // fast replies completed meanwhile
+   long long m_FastAtSend;
+
+   bool done(intptr_t id, void* respPtr)
+   {
+      const sandbox::Response* resp = static_cast<const sandbox::Response*>(respPtr);
+      if (resp != NULL)
+         m_Log->LogInfo("Long poll [", id, "] completed with result v", resp->result_version(), " after ",
+                        m_FastDone - m_FastAtSend, " later queries");
+      m_Waiting = false;
+      return true;
+   }
+};
+
+// Responses are framed as a varint length followed by the serialized
+// sandbox::Response (or ResponseBatch).  rxBuffer keeps any bytes past the
+// frame for the next call.
+bool readResponse(std::shared_ptr<ISocket> socket, std::string& rxBuffer, google::protobuf::MessageLite& resp, double timeout_s = 1.0)
 {
    int numRead = 0;
-   const int bufSize=512;
+   const int bufSize=4096;
    std::vector<char> buffer(bufSize);
-   std::string line("");
-
-   ISocket::ConnectionState_t connectionState;
-   socket->getConnectionState(connectionState);
+   auto start = std::chrono::steady_clock::now();
 
-   if (connectionState == ISocket::STATE_CONNECTED)
+   while (true)
    {
-      if (socket->readLine(buffer.data(), bufSize, numRead, true))
+      CodedInputStream coded_input((const google::protobuf::uint8*)rxBuffer.data(), (int)rxBuffer.size());
+      google::protobuf::uint32 size;
+      if (coded_input.ReadVarint32(&size))
       {
-         line = std::string(buffer.data(), buffer.size());
+         int hdrSize = coded_input.CurrentPosition();
+         if (rxBuffer.size() - hdrSize >= size)
+         {
+            bool ok = resp.ParseFromArray(rxBuffer.data() + hdrSize, size);
+            rxBuffer.erase(0, hdrSize + size);
+            return ok;
+         }
       }
+
+      if (!socket->readBlock(buffer.data(), bufSize, numRead, timeout_s) || (numRead < 0))
+         return false;
+
+      if (numRead > 0)
+         rxBuffer.append(buffer.data(), numRead);
+      else if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeout_s)
+         return false;
    }
+}
 
-   return line;
+// Reads until the reply to command id arrives, skipping any pushes queued
+// ahead of it and late replies to earlier commands (one that timed out, or
+// with command_threads > 1 on the server, one that was overtaken)
+bool readReply(std::shared_ptr<ISocket> socket, std::string& rxBuffer, sandbox::Response& resp, int id, double timeout_s = 1.0)
+{
+   while (readResponse(socket, rxBuffer, resp, timeout_s))
+   {
+      if (resp.id() == id)
+         return true;
+   }
+   return false;
 }
 
-bool sendCommand(std::shared_ptr<ISocket> socket, std::shared_ptr<sandbox::Command> newCmd)
+bool sendMessage(std::shared_ptr<ISocket> socket, const google::protobuf::MessageLite& msg)
 {
    bool ret_val;
 
    std::string buf;
-   newCmd->SerializeToString(&buf);
+   {
+      StringOutputStream sos(&buf);
+      CodedOutputStream coded_output(&sos);
+      coded_output.WriteVarint32((google::protobuf::uint32)msg.ByteSizeLong());
+      msg.SerializeWithCachedSizes(&coded_output);
+   }
 
    ret_val = socket->sendData(buf.c_str(), (int)buf.length());
    return ret_val;
 }
 
+bool sendCommand(std::shared_ptr<ISocket> socket, std::shared_ptr<sandbox::Command> newCmd)
+{
+   return sendMessage(socket, *newCmd);
+}
+
 int main(int argc, char* argv[])
 {
    bool debug = true;
    int cmd_idx = 1;
-   std::string line = "";
+   std::string rxBuffer = "";
+   sandbox::Response resp;
 
    /* Register a handler for control-c */
    signal(SIGINT, sigint_handler);
@@ -76,11 +152,17 @@ int main(int argc, char* argv[])
    string ipAddress;
    int port;
    int freq_hz;
-   if (argc == 4)
+   bool subscribe = false;
+   bool batch = false;
+   bool pipeline = false;
+   if ((argc == 4) || (argc == 5))
    {
        ipAddress = argv[1];
        port = std::stoi(std::string(argv[2]));
        freq_hz = std::stoi(std::string(argv[3]));
+       subscribe = (argc == 5) && (std::string(argv[4]) == "subscribe");
+       batch = (argc == 5) && (std::string(argv[4]) == "batch");
+       pipeline = (argc == 5) && (std::string(argv[4]) == "pipeline");
    }
    else
    {
@@ -101,7 +183,7 @@ int main(int argc, char* argv[])
       return false;
    }
 
-   std::shared_ptr<sandbox::Command> newCmd;
+   std::shared_ptr<sandbox::Command> newCmd = std::shared_ptr<sandbox::Command>(new sandbox::Command);
    newCmd->set_method("status");
 
    for (int i = 0; i < 10; i++, cmd_idx += i)
@@ -114,11 +196,10 @@ int main(int argc, char* argv[])
          m_Log->LogError("Error sending status command");
          return false;
       }
-      // now get the response: "{ "id": 1234,  "result": {"status": "ok" } }"
-      line = readLineFromSocket(m_Socket);
-      if ((line.length() == 0) || (line.find("error") != std::string::npos))
+      // now get the response: id, result.status
+      if (!readReply(m_Socket, rxBuffer, resp, cmd_idx) || (resp.result().status() != sandbox::Response_Status_OK))
       {
-         m_Log->LogError("Status cmd returned error: ", line);
+         m_Log->LogError("Status cmd returned error: ", resp.ShortDebugString());
          return false;
       }
    }
@@ -132,16 +213,187 @@ int main(int argc, char* argv[])
       m_Log->LogError("Error sending status command");
       return false;
    }
-   // now get the response: "{ "id": 1235,  "result": {"success": true } }"
-   line = readLineFromSocket(m_Socket);
-   if ((line.length() == 0) || (line.find("false") != std::string::npos))
+   // now get the response: id, result.success
+   if (!readReply(m_Socket, rxBuffer, resp, cmd_idx) || (resp.result().success() != sandbox::Response_Success_TRUE))
    {
       m_Log->LogError("Start cmd returned error...");
       return false;
    }
 
+   if (subscribe)
+   {
+      // results are pushed every every_n program loops (10 ms each)
+      int every_n = (freq_hz < 100) ? (100 / freq_hz) : 1;
+      int sub_idx = ++cmd_idx;
+
+      m_Log->LogInfo("Sending subscribe command, every ", every_n, " result(s)...");
+      newCmd->set_method("subscribe");
+      newCmd->set_id(sub_idx);
+      newCmd->set_every_n(every_n);
+
+      if (!sendCommand(m_Socket, newCmd) || !readReply(m_Socket, rxBuffer, resp, sub_idx) ||
+          (resp.result().success() != sandbox::Response_Success_TRUE))
+      {
+         m_Log->LogError("Subscribe cmd returned error...");
+         return false;
+      }
+      newCmd->clear_every_n();
+
+      uint32_t last_seq = 0;
+      unsigned gaps = 0;
+      while (!CtrlC)
+      {
+         if (!readResponse(m_Socket, rxBuffer, resp))
+            continue;
+         if ((resp.id() != sub_idx) || !resp.has_sequence())
+            continue;
+
+         const sandbox::Response_Result& result = resp.result();
+         if ((last_seq != 0) && (resp.sequence() != last_seq + 1))
+         {
+            gaps++;
+            m_Log->LogWarn("Missed ", resp.sequence() - last_seq - 1, " push(es) before [", resp.sequence(), "]");
+         }
+         last_seq = resp.sequence();
+
+         std::stringstream ss;
+         ss << "Rcvd push [" << resp.sequence() << "] v" << resp.result_version() << ": " << result.contact_radius();
+         if (result.center_point_size() >= 2)
+            ss << ", " << result.center_point(0) << ", " << result.center_point(1);
+         m_Log->LogInfo(ss.str());
+      }
+
+      m_Log->LogInfo("Sending unsubscribe command (", last_seq, " pushes, ", gaps, " gaps)...");
+      newCmd->set_method("unsubscribe");
+      newCmd->set_id(++cmd_idx);
+
+      if (!sendCommand(m_Socket, newCmd) || !readReply(m_Socket, rxBuffer, resp, cmd_idx))
+      {
+         m_Log->LogError("Unsubscribe cmd returned error...");
+         return false;
+      }
+   }
+
+   if (batch)
+   {
+      // one status and CLIENT_BATCH_QUERIES queries per frame, answered
+      // by a single ResponseBatch
+      sandbox::CommandBatch cmdBatch;
+      sandbox::ResponseBatch respBatch;
+
+      while (!CtrlC)
+      {
+         cmdBatch.Clear();
+         sandbox::Command* statusCmd = cmdBatch.add_commands();
+         statusCmd->set_method("status");
+         statusCmd->set_id(++cmd_idx);
+         for (int i = 0; i < CLIENT_BATCH_QUERIES; i++)
+         {
+            sandbox::Command* queryCmd = cmdBatch.add_commands();
+            queryCmd->set_method("query");
+            queryCmd->set_id(++cmd_idx);
+         }
+
+         if (!sendMessage(m_Socket, cmdBatch))
+         {
+            m_Log->LogError("Error sending command batch");
+            break;
+         }
+
+         if (!readResponse(m_Socket, rxBuffer, respBatch) || (respBatch.responses_size() != cmdBatch.commands_size()))
+         {
+            m_Log->LogError("Error reading response batch");
+         }
+         else
+         {
+            std::stringstream ss;
+            ss << "Rcvd batch [" << respBatch.responses(0).id() << ".." << cmd_idx << "]: status "
+               << ((respBatch.responses(0).result().status() == sandbox::Response_Status_OK) ? "OK" : "ERROR");
+            for (int i = 1; i < respBatch.responses_size(); i++)
+               ss << ", " << respBatch.responses(i).result().contact_radius();
+            m_Log->LogInfo(ss.str());
+         }
+         usleep(sleep_time_ms * 1000);
+      }
+   }
+
+   if (pipeline)
+   {
+      // keeps CLIENT_PIPELINE_DEPTH queries in flight on the one connection,
+      // replies are matched to them by id
+      AsyncClient async(m_Socket);
+      if (!async.Start())
+         return false;
+
+      LongPoll longPoll(m_Log);
+      Callback2<LongPoll, bool, intptr_t, void*> longPollCB(&longPoll, &LongPoll::done, 0, 0);
+
+      std::deque<AsyncClient::ResponseFuture_t> inFlight;
+      sandbox::Command queryCmd;
+      queryCmd.set_method("query");
+      sandbox::Command longPollCmd;
+      longPollCmd.set_method("query");
+
+      uint64_t lastVersion = 0;
+      long long completed = 0;
+      auto lastReport = std::chrono::steady_clock::now();
+
+      while (!CtrlC)
+      {
+         while (inFlight.size() < CLIENT_PIPELINE_DEPTH)
+            inFlight.push_back(async.Send(queryCmd));
+
+         try
+         {
+            sandbox::Response reply = inFlight.front().get();
+            if (reply.result_version() > lastVersion)
+               lastVersion = reply.result_version();
+            completed++;
+            longPoll.m_FastDone = completed;
+         }
+         catch (const std::future_error&)
+         {
+            m_Log->LogError("Query failed, connection lost");
+            break;
+         }
+         inFlight.pop_front();
+
+         auto now = std::chrono::steady_clock::now();
+         double elapsed = std::chrono::duration<double>(now - lastReport).count();
+         if (elapsed >= 1.0)
+         {
+            m_Log->LogInfo("Pipelined ", (long long)(completed / elapsed), " queries/s, ",
+                           CLIENT_PIPELINE_DEPTH, " in flight, result v", lastVersion);
+            completed = 0;
+            longPoll.m_FastDone = 0;
+            lastReport = now;
+
+            if (!longPoll.m_Waiting)
+            {
+               longPoll.m_Waiting = true;
+               longPoll.m_FastAtSend = 0;
+               longPollCmd.set_after_version(lastVersion + CLIENT_LONG_POLL_AHEAD);
+               async.Send(longPollCmd, &longPollCB);
+            }
+         }
+      }
+
+      // collect what is still in flight, so no stale reply is mistaken
+      // for the answer to a later command
+      for (size_t i = 0; i < inFlight.size(); i++)
+      {
+         // the one whose get() failed no longer has a state
+         if (inFlight[i].valid())
+            inFlight[i].wait_for(std::chrono::seconds(1));
+      }
+      inFlight.clear();
+      for (int i = 0; (i < 100) && longPoll.m_Waiting; i++)
+         usleep(10000);
+      async.Stop();
+   }
+
    int unsuccess_cnt = 0;
-   while (!CtrlC && (unsuccess_cnt < 5000))
+   while (!subscribe && !batch && !pipeline && !CtrlC && (unsuccess_cnt < 5000))
    {
       std::stringstream ss;
 
@@ -152,41 +404,26 @@ int main(int argc, char* argv[])
 
       if (sendCommand(m_Socket, newCmd))
       {
-         usleep(sleep_time_ms * 1000);
-         std::string line = readLineFromSocket(m_Socket);
-
-         //cerr << ">>>> send query reply: " << line << endl;
-
-         if (line.length() > 0)
+         if (readReply(m_Socket, rxBuffer, resp, cmd_idx))
          {
-            cJSON* resp_obj = cJSON_Parse(line.c_str());
-            if (resp_obj != NULL)
+            int result_idx = resp.id();
+            const sandbox::Response_Result& result = resp.result();
+
+            if (result.has_contact_radius() && (result.center_point_size() >= 2))
             {
-               int result_idx  = getAttributeDefault_Int(resp_obj, "id", -1);
-
-               cJSON* result_obj = cJSON_GetObjectItem(resp_obj, "result");
-               bool success = (cJSON_GetObjectItem(result_obj, "success")->type == cJSON_True ? true : false);
-
-               if (success)
-               {
-                  unsuccess_cnt = 0;
-                  double contact_radius = cJSON_GetObjectItem(result_obj, "contact_radius")->valuedouble;
-                  double center_pt_x = cJSON_GetObjectItem(result_obj, "center_pt_x")->valuedouble;
-                  double center_pt_y = cJSON_GetObjectItem(result_obj, "center_pt_y")->valuedouble;
-                  ss << "Rcvd result [" << result_idx << "]: " << contact_radius << ", " << center_pt_x << ", " << center_pt_y;
-               }
-               else
-               {
-                  unsuccess_cnt++;
-                  ss << "[" << result_idx << "]: contact radius not found (" << unsuccess_cnt << ")";
-               }
-               m_Log->LogInfo(ss.str());
-               cJSON_Delete(resp_obj);
+               unsuccess_cnt = 0;
+               ss << "Rcvd result [" << result_idx << "]: " << result.contact_radius() << ", " << result.center_point(0) << ", " << result.center_point(1);
             }
             else
             {
-               m_Log->LogError("Error parsing response: ", line);
+               unsuccess_cnt++;
+               ss << "[" << result_idx << "]: contact radius not found (" << unsuccess_cnt << ")";
             }
+            m_Log->LogInfo(ss.str());
+         }
+         else
+         {
+            m_Log->LogError("Error reading query response");
          }
       }
       usleep(sleep_time_ms * 1000);
@@ -201,9 +438,8 @@ int main(int argc, char* argv[])
       m_Log->LogError("Error sending stop command");
       return false;
    }
-   // now get the response: "{ "id": 1235,  "result": {"success": true } }"
-   line = readLineFromSocket(m_Socket);
-   if ((line.length() == 0) || (line.find("false") != std::string::npos))
+   // now get the response: id, result.success
+   if (!readReply(m_Socket, rxBuffer, resp, cmd_idx) || (resp.result().success() != sandbox::Response_Success_TRUE))
    {
       m_Log->LogError("Stop cmd returned error...");
       return false;
@@ -0,0 +1,224 @@
+// Command worker scaling benchmark.
+//
+//   command_bench [command_threads] [connections] [seconds] [method] [port]
+//
+// Runs a CommandProcessor in process with <command_threads> workers and
+// drives it from <connections> client threads, each keeping
+// CLIENT_DEPTH commands of <method> (default query) in flight on its own
+// connection.  Reports replies per second and how many replies came back
+// out of order (a reply whose id is lower than one already received on its
+// connection); the processor's shutdown log shows how many commands each
+// worker stole.
+
+// local:
+#include "Logger.h"
+#include "CommandProcessor.h"
+#include "CNT_JSON.h"
+
+// from system:
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define CLIENT_DEPTH  32
+
+using namespace std;
+
+struct ClientStats_t
+{
+   long long replies;
+   long long outOfOrder;
+};
+
+static size_t putVarint(char* out, uint32_t value)
+{
+   size_t n = 0;
+   while (value >= 0x80)
+   {
+      out[n++] = (char)((value & 0x7f) | 0x80);
+      value >>= 7;
+   }
+   out[n++] = (char)value;
+   return n;
+}
+
+static bool getVarint(const char* data, size_t size, size_t& pos, uint32_t& value)
+{
+   value = 0;
+   for (int shift = 0; (pos < size) && (shift < 35); shift += 7)
+   {
+      unsigned char c = data[pos++];
+      value |= (uint32_t)(c & 0x7f) << shift;
+      if ((c & 0x80) == 0)
+         return true;
+   }
+   return false;
+}
+
+// a delimited Command {id, method}, encoded by hand
+static size_t encodeCommand(char* out, int id, const string& method)
+{
+   char body[256];
+   size_t n = 0;
+   body[n++] = 0x08;
+   n += putVarint(body + n, (uint32_t)id);
+   body[n++] = 0x12;
+   n += putVarint(body + n, (uint32_t)method.size());
+   memcpy(body + n, method.data(), method.size());
+   n += method.size();
+
+   size_t hdr = putVarint(out, (uint32_t)n);
+   memcpy(out + hdr, body, n);
+   return hdr + n;
+}
+
+static void clientLoop(int port, string method, std::atomic<bool>* done, ClientStats_t* stats)
+{
+   int sock = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+   int yes = 1;
+   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+   if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+   {
+      close(sock);
+      return;
+   }
+
+   std::vector<char> out(CLIENT_DEPTH * 300);
+   std::vector<char> in(1 << 16);
+   size_t have = 0;
+   int nextID = 1;
+   int highestID = 0;
+   int inFlight = 0;
+
+   for (;;)
+   {
+      // top the pipeline up, unless it is time to drain it
+      size_t outLen = 0;
+      while (!done->load(std::memory_order_relaxed) && (inFlight < CLIENT_DEPTH))
+      {
+         outLen += encodeCommand(out.data() + outLen, nextID++, method);
+         inFlight++;
+      }
+      if ((outLen > 0) && (send(sock, out.data(), outLen, MSG_NOSIGNAL) != (ssize_t)outLen))
+         break;
+
+      if (inFlight == 0)
+         break;
+
+      ssize_t n = recv(sock, in.data() + have, in.size() - have, 0);
+      if (n <= 0)
+         break;
+      have += n;
+
+      size_t pos = 0;
+      for (;;)
+      {
+         size_t start = pos;
+         uint32_t size;
+         if (!getVarint(in.data(), have, pos, size) || (have - pos < size))
+         {
+            pos = start;
+            break;
+         }
+
+         // field 1 (id) comes first in a Response
+         size_t field = pos;
+         uint32_t tag, id;
+         if (getVarint(in.data(), pos + size, field, tag) && (tag == 0x08) &&
+             getVarint(in.data(), pos + size, field, id))
+         {
+            if ((int)id < highestID)
+               stats->outOfOrder++;
+            else
+               highestID = (int)id;
+         }
+
+         pos += size;
+         stats->replies++;
+         inFlight--;
+      }
+
+      memmove(in.data(), in.data() + pos, have - pos);
+      have -= pos;
+   }
+
+   close(sock);
+}
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("Bench", false));
+
+   int threads     = (argc > 1) ? std::stoi(argv[1]) : 1;
+   int connections = (argc > 2) ? std::stoi(argv[2]) : 4;
+   int seconds     = (argc > 3) ? std::stoi(argv[3]) : 3;
+   string method   = (argc > 4) ? argv[4] : "query";
+   int port        = (argc > 5) ? std::stoi(argv[5]) : 12073;
+
+   if ((threads <= 0) || (connections <= 0) || (seconds <= 0))
+   {
+      m_Log->LogError("usage: command_bench [command_threads] [connections] [seconds] [method] [port]");
+      return 1;
+   }
+
+   string configText = "{\"ipAddress\":\"127.0.0.1\",\"port\":" + std::to_string(port) +
+                       ",\"command_threads\":" + std::to_string(threads) +
+                       ",\"exit_on_quit\":false,\"imgEngine\":{\"imgEng_type\":\"fake\"}}";
+   cJSON* config = cJSON_Parse(configText.c_str());
+
+   std::shared_ptr<CommandProcessor> cmd = std::shared_ptr<CommandProcessor>(new CommandProcessor(false));
+   if ((config == NULL) || !cmd->init(config) || !cmd->Start())
+   {
+      m_Log->LogError("Command Processor initialization failed");
+      return 1;
+   }
+   usleep(100000);
+
+   std::atomic<bool> done(false);
+   std::vector<ClientStats_t> stats(connections);
+   std::vector<std::thread> clientThreads;
+   for (int i = 0; i < connections; i++)
+   {
+      stats[i].replies = 0;
+      stats[i].outOfOrder = 0;
+      clientThreads.push_back(std::thread(clientLoop, port, method, &done, &stats[i]));
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   sleep(seconds);
+   done = true;
+   for (auto& t : clientThreads)
+      t.join();
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   long long replies = 0;
+   long long outOfOrder = 0;
+   for (int i = 0; i < connections; i++)
+   {
+      replies += stats[i].replies;
+      outOfOrder += stats[i].outOfOrder;
+   }
+
+   cmd->Shutdown();
+   cJSON_Delete(config);
+
+   m_Log->LogInfo(threads, " command thread(s), ", connections, " connections, ", method, ": ",
+                  (long long)(replies / elapsed), " replies/s, ", outOfOrder, " replies out of order");
+   return 0;
+}
@@ -0,0 +1,127 @@
+// Per-message receive dispatch benchmark.
+//
+//   dispatch_bench [frames]
+//
+// Times handing <frames> (default 100000000) received frames from a
+// transport to its receive callback, once through the old ICallback path
+// (a Frame_t packed behind void*, a virtual Invoke and a stored return
+// value) and once through SocketTransport::RecvDelegate_t.  The transport
+// side is out of line, like SocketTransport, so the callback is only known
+// at run time.  A last pass calls the Delegate where the target is
+// visible, which the compiler inlines completely.
+
+// local:
+#include "Logger.h"
+#include "Callback.h"
+#include "SocketTransport.h"
+
+// from system:
+#include <memory>
+#include <chrono>
+
+#include <stdint.h>
+
+using namespace std;
+
+struct Frame_t
+{
+   const char* data;
+   int numBytes;
+};
+
+class Sink
+{
+public:
+   Sink() : bytes(0), frames(0)
+   {
+   }
+
+   bool recvOld(intptr_t connID, void* msg)
+   {
+      Frame_t& frame = *static_cast<Frame_t*>(msg);
+      bytes += frame.numBytes + connID;
+      frames++;
+      return true;
+   }
+
+   bool recvNew(int connID, const char* data, int numBytes)
+   {
+      (void)data;
+      bytes += numBytes + connID;
+      frames++;
+      return true;
+   }
+
+   uint64_t bytes;
+   uint64_t frames;
+};
+
+// stands in for SocketTransport's receive thread
+class Transport
+{
+public:
+   __attribute__((noinline)) void dispatchOld(int connID, const char* data, int numBytes)
+   {
+      Frame_t frame;
+      frame.data = data;
+      frame.numBytes = numBytes;
+      m_RecvCallbackOld->Invoke((void*)(intptr_t)connID, &frame);
+   }
+
+   __attribute__((noinline)) void dispatchNew(int connID, const char* data, int numBytes)
+   {
+      if (m_RecvCallback)
+         m_RecvCallback(connID, data, numBytes);
+   }
+
+   ICallback* m_RecvCallbackOld;
+   SocketTransport::RecvDelegate_t m_RecvCallback;
+};
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("Bench", false));
+
+   long frames = (argc > 1) ? std::stol(argv[1]) : 100000000;
+   if (frames <= 0)
+   {
+      m_Log->LogError("usage: dispatch_bench [frames]");
+      return 1;
+   }
+
+   Sink sink;
+   Transport transport;
+   transport.m_RecvCallbackOld = new Callback2<Sink, bool, intptr_t, void*>(&sink, &Sink::recvOld, 0, 0);
+   transport.m_RecvCallback = SocketTransport::RecvDelegate_t::Bind<Sink, &Sink::recvNew>(&sink);
+   char data[64] = {0};
+
+   // the first pass warms up
+   for (int pass = 0; pass < 2; pass++)
+   {
+      auto t0 = std::chrono::steady_clock::now();
+      for (long i = 0; i < frames; i++)
+         transport.dispatchOld(i & 7, data, 10);
+
+      auto t1 = std::chrono::steady_clock::now();
+      for (long i = 0; i < frames; i++)
+         transport.dispatchNew(i & 7, data, 10);
+      auto t2 = std::chrono::steady_clock::now();
+
+      m_Log->LogInfo(pass ? "measured" : "warm-up ", ": ICallback ",
+                     std::chrono::duration<double, std::nano>(t1 - t0).count() / frames, " ns/frame, Delegate ",
+                     std::chrono::duration<double, std::nano>(t2 - t1).count() / frames, " ns/frame");
+   }
+
+   SocketTransport::RecvDelegate_t local = SocketTransport::RecvDelegate_t::Bind<Sink, &Sink::recvNew>(&sink);
+   auto t0 = std::chrono::steady_clock::now();
+   for (long i = 0; i < frames; i++)
+      local(i & 7, data, 10);
+   auto t1 = std::chrono::steady_clock::now();
+
+   m_Log->LogInfo("Delegate with the target visible: ",
+                  std::chrono::duration<double, std::nano>(t1 - t0).count() / frames, " ns/frame (",
+                  sink.frames, " frames delivered)");
+
+   delete transport.m_RecvCallbackOld;
+   return 0;
+}
@@ -0,0 +1,77 @@
+// Receive-path debug logging benchmark.
+//
+//   log_bench [commands]
+//
+// Parses a query Command <commands> times (default 2000000) the way
+// recvCBRoutine does, with the logger's debug flag off, three ways:
+// parse only, parse plus an eager LogDebug of the reply line (whose
+// arguments, including DebugString, are evaluated before the call
+// returns) and parse plus the same line through LOG_DEBUG.  Reports the
+// extra nanoseconds per command for each.  Build with
+// make LOG_MIN_LEVEL=LOG_LEVEL_INFO to see LOG_DEBUG compiled out.
+
+// local:
+#include "Logger.h"
+#include "payload.pb.h"
+
+// from system:
+#include <string>
+#include <memory>
+#include <chrono>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("Bench", false));
+
+   int commands = (argc > 1) ? std::stoi(argv[1]) : 2000000;
+   if (commands <= 0)
+   {
+      m_Log->LogError("usage: log_bench [commands]");
+      return 1;
+   }
+
+   std::shared_ptr<Logger> rxLog = std::shared_ptr<Logger>(new Logger("Receive", false));
+
+   sandbox::Command cmd;
+   cmd.set_id(42);
+   cmd.set_method("query");
+   string wire = cmd.SerializeAsString();
+   volatile long sink = 0;
+
+   // the first pass warms up; the second is the one to read
+   for (int pass = 0; pass < 2; pass++)
+   {
+      auto t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < commands; i++)
+      {
+         cmd.ParseFromString(wire);
+         sink += cmd.id();
+      }
+
+      auto t1 = std::chrono::steady_clock::now();
+      for (int i = 0; i < commands; i++)
+      {
+         cmd.ParseFromString(wire);
+         rxLog->LogDebug("Reply ID: ", i, " msg size: ", cmd.ByteSizeLong(), "->", cmd.DebugString());
+      }
+
+      auto t2 = std::chrono::steady_clock::now();
+      for (int i = 0; i < commands; i++)
+      {
+         cmd.ParseFromString(wire);
+         LOG_DEBUG(rxLog, "Reply ID: ", i, " msg size: ", cmd.ByteSizeLong(), "->", cmd.DebugString());
+      }
+      auto t3 = std::chrono::steady_clock::now();
+
+      double parseNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / commands;
+      double eagerNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / commands - parseNs;
+      double lazyNs  = std::chrono::duration<double, std::nano>(t3 - t2).count() / commands - parseNs;
+
+      m_Log->LogInfo(pass ? "measured" : "warm-up ", ": parse ", parseNs, " ns, eager LogDebug +", eagerNs,
+                     " ns, LOG_DEBUG +", lazyNs, " ns per command (LOG_MIN_LEVEL ", LOG_MIN_LEVEL, ")");
+   }
+
+   return 0;
+}
@@ -0,0 +1,279 @@
+/**************************************************************************
+*
+*		     Source:  log_decode.cpp
+*		    Project:  ScorpionServer
+*
+*		     Author: trafferty
+*		       Date: Oct 17, 2026
+*
+*		Description:
+*		  > Turns a binary trace log (see BinaryLog.h) back into text,
+*		    one line per record:
+*
+*		      2026-10-17 06:45:43.123456789: <formatted message>
+*
+*		    Usage: log_decode [-v] <binary log>
+*		      -v  append the call site (file:line) to every line
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "BinaryLog.h"
+
+struct Definition_t
+{
+    std::string argTypes;
+    std::string format;
+    std::string file;
+    int         line;
+};
+
+// reads little pieces off a record, false once it runs past the end
+class Reader
+{
+public:
+    Reader(const char* data, size_t size) : m_Pos(data), m_End(data + size) {}
+
+    bool get(void* out, size_t size)
+    {
+        if ((size_t)(m_End - m_Pos) < size)
+            return false;
+        memcpy(out, m_Pos, size);
+        m_Pos += size;
+        return true;
+    }
+
+    bool getString(std::string& out)
+    {
+        uint16_t len;
+        if (!get(&len, 2) || ((size_t)(m_End - m_Pos) < len))
+            return false;
+        out.assign(m_Pos, len);
+        m_Pos += len;
+        return true;
+    }
+
+private:
+    const char* m_Pos;
+    const char* m_End;
+};
+
+//=============================================================================
+// formatRecord
+//-----------------------------------------------------------------------------
+// printf's the record's arguments through its format one conversion at a
+// time: every integer was stored as 64 bits, so the length modifier is
+// replaced with ll, whatever the call site wrote.
+//=============================================================================
+static std::string formatRecord(const Definition_t& def, Reader& args)
+{
+    std::string out;
+    const std::string& fmt = def.format;
+    size_t argIndex = 0;
+    char piece[BINARY_LOG_MAX_STRING + 64];
+
+    for (size_t i = 0; i < fmt.size(); i++)
+    {
+        if (fmt[i] != '%')
+        {
+            out += fmt[i];
+            continue;
+        }
+
+        if ((i + 1 < fmt.size()) && (fmt[i + 1] == '%'))
+        {
+            out += '%';
+            i++;
+            continue;
+        }
+
+        // flags, width and precision are kept, length modifiers are not
+        std::string spec("%");
+        size_t j = i + 1;
+        while ((j < fmt.size()) && strchr("-+ #0123456789.", fmt[j]))
+            spec += fmt[j++];
+        while ((j < fmt.size()) && strchr("hlLqjzt", fmt[j]))
+            j++;
+        if (j >= fmt.size())
+            break;
+
+        char conv = fmt[j];
+        i = j;
+
+        if (argIndex >= def.argTypes.size())
+        {
+            out += "<missing>";
+            continue;
+        }
+
+        char type = def.argTypes[argIndex++];
+        if (type == BINLOG_ARG_STRING)
+        {
+            std::string s;
+            if (!args.getString(s))
+                return out + "<truncated>";
+            snprintf(piece, sizeof(piece), (spec + 's').c_str(), s.c_str());
+        }
+        else
+        {
+            uint64_t raw;
+            if (!args.get(&raw, 8))
+                return out + "<truncated>";
+
+            if (strchr("eEfFgGaA", conv))
+            {
+                double d;
+                memcpy(&d, &raw, 8);
+                if (type != BINLOG_ARG_DOUBLE)
+                    d = (type == BINLOG_ARG_INT) ? (double)(int64_t)raw : (double)raw;
+                snprintf(piece, sizeof(piece), (spec + conv).c_str(), d);
+            }
+            else if (conv == 'p')
+            {
+                snprintf(piece, sizeof(piece), (spec + 'p').c_str(), (void*)(uintptr_t)raw);
+            }
+            else if (conv == 'c')
+            {
+                snprintf(piece, sizeof(piece), (spec + 'c').c_str(), (int)raw);
+            }
+            else
+            {
+                if (type == BINLOG_ARG_DOUBLE)
+                {
+                    double d;
+                    memcpy(&d, &raw, 8);
+                    raw = (uint64_t)(int64_t)d;
+                }
+                snprintf(piece, sizeof(piece), (spec + "ll" + conv).c_str(), (long long)raw);
+            }
+        }
+        out += piece;
+    }
+
+    return out;
+}
+
+int main(int argc, char* argv[])
+{
+    bool verbose = false;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else
+            path = argv[i];
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "Usage: %s [-v] <binary log>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    BinaryLogHeader_t header;
+    if ((fread(&header, sizeof(header), 1, file) != 1) ||
+        (memcmp(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic)) != 0))
+    {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    std::vector<char> records;
+    char chunk[65536];
+    size_t numRead;
+    while ((numRead = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        records.insert(records.end(), chunk, chunk + numRead);
+    fclose(file);
+
+    // ticks -> wall clock; the Open calibration is only used if the log
+    // was never closed
+    double nsPerTick = 1.0 / header.ticksPerNs;
+    if ((header.endTicks > header.startTicks) && (header.endNs > header.startNs))
+        nsPerTick = (double)(header.endNs - header.startNs) / (double)(header.endTicks - header.startTicks);
+
+    std::map<uint16_t, Definition_t> definitions;
+    uint64_t numRecords = 0;
+    size_t pos = 0;
+
+    while (pos + sizeof(BinaryLogRecord_t) <= records.size())
+    {
+        BinaryLogRecord_t rec;
+        memcpy(&rec, &records[pos], sizeof(rec));
+        if ((rec.size < sizeof(rec)) || (pos + rec.size > records.size()))
+            break;      // unfinished, the writer was stopped mid-record
+        if ((rec.size % BINARY_LOG_ALIGN) != 0)
+        {
+            fprintf(stderr, "%s: misaligned record at offset %zu\n", path, pos);
+            break;
+        }
+
+        // the body includes the record's padding, which the fields
+        // simply stop short of
+        Reader body(&records[pos + sizeof(rec)], rec.size - sizeof(rec));
+        pos += rec.size;
+
+        if (rec.id == 0)
+        {
+            uint16_t id;
+            int32_t line;
+            uint16_t numArgs;
+            Definition_t def;
+
+            if (!body.get(&id, 2) || !body.get(&line, 4) || !body.get(&numArgs, 2))
+                continue;
+            def.argTypes.resize(numArgs);
+            if (!body.get(&def.argTypes[0], numArgs) || !body.getString(def.file) || !body.getString(def.format))
+                continue;
+            def.line = line;
+            definitions[id] = def;
+            continue;
+        }
+
+        int64_t deltaNs = (int64_t)((double)(int64_t)(rec.ticks - header.startTicks) * nsPerTick);
+        uint64_t ns = header.startNs + deltaNs;
+        uint64_t fraction = ns % 1000000000ULL;
+        time_t seconds = (time_t)(ns / 1000000000ULL);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%F %T", &local);
+
+        std::map<uint16_t, Definition_t>::const_iterator def = definitions.find(rec.id);
+        if (def == definitions.end())
+        {
+            printf("%s.%09" PRIu64 ": <unknown format %u>\n", stamp, fraction, rec.id);
+        }
+        else
+        {
+            std::string text = formatRecord(def->second, body);
+            if (verbose)
+                printf("%s.%09" PRIu64 ": %s  (%s:%d)\n", stamp, fraction, text.c_str(),
+                       def->second.file.c_str(), def->second.line);
+            else
+                printf("%s.%09" PRIu64 ": %s\n", stamp, fraction, text.c_str());
+        }
+        numRecords++;
+    }
+
+    fprintf(stderr, "%" PRIu64 " record(s), %zu format(s), %" PRIu64 " dropped\n",
+            numRecords, definitions.size(), header.dropped);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Stress test for MPMCQueue.
+//
+//   queue_stress [producers] [consumers] [items] [capacity]
+//
+// <producers> threads each push <items> numbered items (carrying a
+// shared_ptr, so a lost or doubled copy shows up as a wrong payload)
+// into one queue of <capacity>, retrying while it is full, and
+// <consumers> threads pop them concurrently.  Checks that every item
+// arrives exactly once and that each consumer sees any one producer's
+// items in the order they were pushed.  Exits 0 if both hold.
+
+// local:
+#include "Logger.h"
+#include "MPMCQueue.h"
+
+// from system:
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+struct Item_t
+{
+   int producer;
+   long seq;
+   std::shared_ptr<int> payload;
+};
+
+static void producerLoop(MPMCQueue<Item_t>* queue, int producer, long items)
+{
+   Item_t item;
+   item.producer = producer;
+   item.payload = std::make_shared<int>(producer);
+
+   for (item.seq = 0; item.seq < items; )
+   {
+      if (queue->Push(item))
+         item.seq++;
+      else
+         std::this_thread::yield();
+   }
+}
+
+static void consumerLoop(MPMCQueue<Item_t>* queue, int producers, long items,
+                         std::vector<std::atomic<unsigned char> >* seen,
+                         std::atomic<long>* popped, std::atomic<long>* errors)
+{
+   long total = producers * items;
+   std::vector<long> last(producers, -1);
+   Item_t item;
+
+   while (popped->load(std::memory_order_relaxed) < total)
+   {
+      if (!queue->Pop(item))
+      {
+         std::this_thread::yield();
+         continue;
+      }
+      popped->fetch_add(1, std::memory_order_relaxed);
+
+      if ((item.producer < 0) || (item.producer >= producers) || (item.seq < 0) || (item.seq >= items) ||
+          !item.payload || (*item.payload != item.producer))
+      {
+         (*errors)++;
+         continue;
+      }
+
+      // one consumer must see a producer's items in push order
+      if (item.seq <= last[item.producer])
+         (*errors)++;
+      last[item.producer] = item.seq;
+
+      (*seen)[item.producer * items + item.seq]++;
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("QueueStress", false));
+
+   int producers = (argc > 1) ? std::stoi(argv[1]) : 4;
+   int consumers = (argc > 2) ? std::stoi(argv[2]) : 3;
+   long items    = (argc > 3) ? std::stol(argv[3]) : 500000;
+   int capacity  = (argc > 4) ? std::stoi(argv[4]) : 1024;
+
+   if ((producers <= 0) || (consumers <= 0) || (items <= 0) || (capacity <= 0))
+   {
+      m_Log->LogError("usage: queue_stress [producers] [consumers] [items] [capacity]");
+      return 1;
+   }
+
+   MPMCQueue<Item_t> queue(capacity);
+   std::vector<std::atomic<unsigned char> > seen(producers * items);
+   for (size_t i = 0; i < seen.size(); i++)
+      seen[i].store(0, std::memory_order_relaxed);
+   std::atomic<long> popped(0);
+   std::atomic<long> errors(0);
+
+   auto start = std::chrono::steady_clock::now();
+
+   std::vector<std::thread> threads;
+   for (int i = 0; i < consumers; i++)
+      threads.push_back(std::thread(consumerLoop, &queue, producers, items, &seen, &popped, &errors));
+   for (int i = 0; i < producers; i++)
+      threads.push_back(std::thread(producerLoop, &queue, i, items));
+   for (auto& t : threads)
+      t.join();
+
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   long missing = 0;
+   long duplicated = 0;
+   for (size_t i = 0; i < seen.size(); i++)
+   {
+      if (seen[i] == 0)
+         missing++;
+      else if (seen[i] > 1)
+         duplicated++;
+   }
+
+   MPMCQueue<Item_t>::Stats_t stats = queue.GetStats();
+   m_Log->LogInfo(producers, " producers, ", consumers, " consumers, capacity ", queue.capacity(), ": ",
+                  (long long)(popped / elapsed), " items/s, ", stats.rejected, " pushes found it full");
+
+   if ((missing > 0) || (duplicated > 0) || (errors > 0) || (stats.depth != 0))
+   {
+      m_Log->LogError("FAILED: ", missing, " missing, ", duplicated, " duplicated, ", errors.load(),
+                      " out of order or corrupt, ", stats.depth, " left queued");
+      return 1;
+   }
+
+   m_Log->LogInfo("OK: ", producers * items, " items delivered exactly once, in order per producer");
+   return 0;
+}
@@ -0,0 +1,182 @@
+// Contention benchmark for SeqLock.
+//
+//   seqlock_bench [readers] [seconds] [write_period_us]
+//
+// One writer stores a result-sized snapshot every <write_period_us>
+// (like programLoop publishing m_latestResult) while <readers> threads
+// load it as fast as they can (like query).  Runs once with SeqLock and
+// once with a mutex around a plain copy, and reports reads per second
+// for each.  Every snapshot is filled with one value, so a torn read is
+// detected; the exit status is 1 if there was any.
+
+// local:
+#include "Logger.h"
+#include "SeqLock.h"
+
+// from system:
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+
+// the size of CommandProcessor::ResultSnapshot_t
+struct Snapshot_t
+{
+   double   values[3];
+   uint64_t words[9];
+};
+
+static void fill(Snapshot_t& snapshot, uint64_t value)
+{
+   for (size_t i = 0; i < 3; i++)
+      snapshot.values[i] = (double)value;
+   for (size_t i = 0; i < 9; i++)
+      snapshot.words[i] = value;
+}
+
+static bool consistent(const Snapshot_t& snapshot)
+{
+   for (size_t i = 0; i < 3; i++)
+      if (snapshot.values[i] != (double)snapshot.words[0])
+         return false;
+   for (size_t i = 1; i < 9; i++)
+      if (snapshot.words[i] != snapshot.words[0])
+         return false;
+   return true;
+}
+
+class Shared
+{
+public:
+   Shared(bool useMutex) : m_UseMutex(useMutex)
+   {
+      pthread_mutex_init(&m_Working_Snapshot, NULL);
+      fill(m_Snapshot, 0);
+   }
+
+   ~Shared()
+   {
+      pthread_mutex_destroy(&m_Working_Snapshot);
+   }
+
+   void Store(const Snapshot_t& snapshot)
+   {
+      if (!m_UseMutex)
+      {
+         m_SeqLock.Store(snapshot);
+         return;
+      }
+
+      pthread_mutex_lock(&m_Working_Snapshot);
+      {
+         m_Snapshot = snapshot;
+      }
+      pthread_mutex_unlock(&m_Working_Snapshot);
+   }
+
+   void Load(Snapshot_t& snapshot)
+   {
+      if (!m_UseMutex)
+      {
+         m_SeqLock.Load(snapshot);
+         return;
+      }
+
+      pthread_mutex_lock(&m_Working_Snapshot);
+      {
+         snapshot = m_Snapshot;
+      }
+      pthread_mutex_unlock(&m_Working_Snapshot);
+   }
+
+private:
+   bool m_UseMutex;
+   SeqLock<Snapshot_t> m_SeqLock;
+   pthread_mutex_t m_Working_Snapshot;
+   Snapshot_t m_Snapshot;
+};
+
+static void writerLoop(Shared* shared, int periodUs, std::atomic<bool>* done, long long* writes)
+{
+   Snapshot_t snapshot;
+   for (uint64_t value = 1; !done->load(std::memory_order_relaxed); value++)
+   {
+      fill(snapshot, value);
+      shared->Store(snapshot);
+      (*writes)++;
+      if (periodUs > 0)
+         usleep(periodUs);
+   }
+}
+
+static void readerLoop(Shared* shared, std::atomic<bool>* done, long long* reads, long long* torn)
+{
+   Snapshot_t snapshot;
+   while (!done->load(std::memory_order_relaxed))
+   {
+      shared->Load(snapshot);
+      if (!consistent(snapshot))
+         (*torn)++;
+      (*reads)++;
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("Bench", false));
+
+   int readers  = (argc > 1) ? std::stoi(argv[1]) : 4;
+   int seconds  = (argc > 2) ? std::stoi(argv[2]) : 2;
+   int periodUs = (argc > 3) ? std::stoi(argv[3]) : 100;
+
+   if ((readers <= 0) || (seconds <= 0) || (periodUs < 0))
+   {
+      m_Log->LogError("usage: seqlock_bench [readers] [seconds] [write_period_us]");
+      return 1;
+   }
+
+   long long totalTorn = 0;
+
+   for (int useMutex = 0; useMutex < 2; useMutex++)
+   {
+      Shared shared(useMutex != 0);
+      std::atomic<bool> done(false);
+      long long writes = 0;
+      std::vector<long long> reads(readers, 0);
+      std::vector<long long> torn(readers, 0);
+
+      std::thread writer(writerLoop, &shared, periodUs, &done, &writes);
+      std::vector<std::thread> readerThreads;
+      for (int i = 0; i < readers; i++)
+         readerThreads.push_back(std::thread(readerLoop, &shared, &done, &reads[i], &torn[i]));
+
+      auto start = std::chrono::steady_clock::now();
+      sleep(seconds);
+      done = true;
+      writer.join();
+      for (auto& t : readerThreads)
+         t.join();
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      long long totalReads = 0;
+      long long tornReads = 0;
+      for (int i = 0; i < readers; i++)
+      {
+         totalReads += reads[i];
+         tornReads += torn[i];
+      }
+      totalTorn += tornReads;
+
+      m_Log->LogInfo(useMutex ? "mutex  " : "seqlock", ": ", readers, " readers, ",
+                     (long long)(totalReads / elapsed), " reads/s, ",
+                     (long long)(writes / elapsed), " writes/s, ", tornReads, " torn");
+   }
+
+   return (totalTorn == 0) ? 0 : 1;
+}
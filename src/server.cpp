@@ -1,5 +1,4 @@
 // from system:
-#include <unistd.h>  // for usleep
 #include <sstream>
 #include <memory>
 #include <signal.h>
@@ -84,10 +83,10 @@ int main(int argc, char* argv[])
 
     cmd->Start();
 
-    while (!CtrlC && cmd->IsRunning())
+    // commands run on the processor's workers; just wait for a quit
+    // command or ctrl-c here
+    while (!CtrlC && cmd->WaitForShutdown(0.25))
     {
-       if (!cmd->doWork())
-          usleep(1 * 1000);
     }
 
     m_Log->LogInfo("Shutting down and exiting...");
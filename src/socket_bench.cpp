@@ -0,0 +1,170 @@
+// Loopback benchmark for the server side ISocket backends.
+//
+//   socket_bench <epoll|io_uring> [clients] [seconds] [msg_bytes] [port]
+//
+// Starts an echo server on the chosen backend and drives it from
+// <clients> threads, each doing blocking send/recv round trips of
+// <msg_bytes> on its own connection.  Reports round trips per second and
+// the mean round trip time.
+
+// local:
+#include "Callback.h"
+#include "Logger.h"
+#include "ISocket.h"
+#include "LinuxSocket.h"
+#include "IoUringSocket.h"
+
+// from system:
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+class EchoServer
+{
+public:
+   EchoServer(std::shared_ptr<ISocket> socket) : m_Done(false), m_Socket(socket)
+   {
+      m_callback = new Callback2<EchoServer, bool, intptr_t, void*>(this, &EchoServer::recvCBRoutine, 0, 0);
+      m_Socket->RegisterRecvCallback(1, m_callback);
+   }
+
+   ~EchoServer()
+   {
+      delete m_callback;
+   }
+
+   void run()
+   {
+      while (!m_Done)
+         m_Socket->PollEvents(0.1);
+   }
+
+   std::atomic<bool> m_Done;
+
+private:
+   std::shared_ptr<ISocket> m_Socket;
+   Callback2<EchoServer, bool, intptr_t, void*>* m_callback;
+
+   bool recvCBRoutine(intptr_t connID, void* recvEvent)
+   {
+      ISocket::RecvEvent_t &event = *static_cast<ISocket::RecvEvent_t*>(recvEvent);
+      if (event.event == ISocket::EVENT_DATA)
+         m_Socket->sendData((int)connID, event.data, event.numBytes);
+      return true;
+   }
+};
+
+static void clientLoop(int port, int msgBytes, std::atomic<bool>* done, long long* roundTrips)
+{
+   int sock = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_in addr;
+   memset(&addr, '\0', sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   inet_aton("127.0.0.1", &addr.sin_addr);
+
+   if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+   {
+      close(sock);
+      return;
+   }
+
+   int yes = 1;
+   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+   std::vector<char> msg(msgBytes, 'x');
+   std::vector<char> reply(msgBytes);
+
+   while (!*done)
+   {
+      if (send(sock, msg.data(), msgBytes, 0) != msgBytes)
+         break;
+
+      int got = 0;
+      while (got < msgBytes)
+      {
+         int n = recv(sock, reply.data() + got, msgBytes - got, 0);
+         if (n <= 0)
+         {
+            close(sock);
+            return;
+         }
+         got += n;
+      }
+      (*roundTrips)++;
+   }
+
+   close(sock);
+}
+
+int main(int argc, char* argv[])
+{
+   std::shared_ptr<Logger> m_Log = std::shared_ptr<Logger>(new Logger("Bench", false));
+
+   if (argc < 2)
+   {
+      m_Log->LogError("usage: socket_bench <epoll|io_uring> [clients] [seconds] [msg_bytes] [port]");
+      return 1;
+   }
+
+   string backend(argv[1]);
+   int clients  = (argc > 2) ? std::stoi(argv[2]) : 16;
+   int seconds  = (argc > 3) ? std::stoi(argv[3]) : 5;
+   int msgBytes = (argc > 4) ? std::stoi(argv[4]) : 64;
+   int port     = (argc > 5) ? std::stoi(argv[5]) : 12071;
+
+   std::shared_ptr<ISocket> socket;
+   if (backend == "io_uring")
+      socket = std::shared_ptr<ISocket>(new IoUringSocket("BenchSocket", false));
+   else
+      socket = std::shared_ptr<ISocket>(new LinuxSocket("BenchSocket", false));
+
+   if (!socket->init(ISocket::ConnectionMode_t::CONN_MODE_SERVER, "127.0.0.1", port))
+   {
+      m_Log->LogError("Socket initialization failed for backend ", backend);
+      return 1;
+   }
+
+   EchoServer server(socket);
+   std::thread serverThread(&EchoServer::run, &server);
+
+   std::atomic<bool> done(false);
+   std::vector<long long> roundTrips(clients, 0);
+   std::vector<std::thread> clientThreads;
+   for (int i = 0; i < clients; i++)
+      clientThreads.push_back(std::thread(clientLoop, port, msgBytes, &done, &roundTrips[i]));
+
+   auto start = std::chrono::steady_clock::now();
+   sleep(seconds);
+   done = true;
+   for (auto& t : clientThreads)
+      t.join();
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   server.m_Done = true;
+   serverThread.join();
+   socket->CloseConnection();
+
+   long long total = 0;
+   for (long long n : roundTrips)
+      total += n;
+
+   double rate = total / elapsed;
+   m_Log->LogInfo(backend, ": ", clients, " clients, ", msgBytes, " byte msgs: ",
+                  (long long)rate, " round trips/s, mean rtt ",
+                  (rate > 0) ? (1e6 * clients / rate) : 0.0, " us");
+
+   return 0;
+}